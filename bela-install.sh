@@ -1,5 +1,23 @@
 #!/bin/bash
 
+# Copy the extension to a Bela attached to this computer:
+#
+#     bela-install.sh [install prefix]
+#
+# With the CMAKE_INSTALL_PREFIX of a cross-compiled build, that build is
+# copied. Without it, the prebuilt binary in Extensions is, which is from
+# the first version of the plugin and doesn't have BNORotate, BNOBus,
+# BNOHistory or calibration profiles.
+
 wd=$(dirname $0)
+src=${1:-$wd/Extensions}
+
+if [ -z "$(find "$src/BNO" -name BNO_scsynth.so 2>/dev/null)" ]; then
+    echo "No BNO_scsynth.so in $src/BNO, build and install the plugin first" >&2
+    exit 1
+fi
+if [ -z "$1" ]; then
+    echo "Installing the prebuilt first version of the plugin"
+fi
 
-scp -r $wd/Extensions/BNO root@bela.local:/root/.local/share/SuperCollider/Extensions/
+scp -r "$src/BNO" root@bela.local:/root/.local/share/SuperCollider/Extensions/
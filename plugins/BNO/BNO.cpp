@@ -1,10 +1,14 @@
 #include <atomic>
-#include <Bela.h>
 #include "SC_PlugIn.h"
-#include <thread>
+
+#ifdef SUPERNOVA
+// The service's command queue and update() assume a single audio thread
+#error "BNO doesn't support supernova"
+#endif
 
 //#include "mock.hpp"
-#include "imu/SC_BNO055.h"
+#include "BNO_Service.h"
+#include "imu/BNO_Rotation.h"
 
 // written with reference to the chapter "Writing Unit Generator Plug-ins" in The SuperCollider Book
 // and also http://doc.sccode.org/Guides/WritingUGens.html accessed March 2, 2015
@@ -12,236 +16,874 @@
 
 static InterfaceTable *ft;
 
-enum bnoTask {
-    TASK_STOP = 0,
-    TASK_RUN=2,
-    TASK_CALIBRATE_IDLE=4,
-    TASK_CMD=8,
-    TASK_CALIBRATE_1=9,
-    TASK_CALIBRATE_2=10,
-    TASK_SAVE=11,
-    TASK_LOAD=12
-};
-
 struct BNO : public Unit {
-    //Outputs 3 values
+    //Outputs 3 values, 5 for the features
     static const int ACCEL = 0;
     static const int GYRO = 1;
     static const int MAG = 2;
     static const int ORIENTATION = 3;
 
-    SC_BNO055* bno;
+    BNO_Service* service;
 
-    int currentTask = TASK_STOP;
     int channel = ORIENTATION;
     int outputs = 3;
     float m_caltrig;
     float m_loadtrig;
     float m_savetrig;
+    bool m_triggers; // poll the trigger inputs
+
+    int m_pendingCal, m_pendingLoad, m_pendingSave; // triggers not yet queued
+
+    // onsets
+    bool m_onsetSeen, m_onsetPending;
+    uint32_t m_onsetCount;
+    uint64_t m_onsetDue, m_lastOnset, m_onsetLatency;
+    float m_onsetStrength, m_onsetInterval;
+
+    // chip interrupts
+    bool m_intSeen;
+    uint8_t m_intCounts[BNO_NUM_INTERRUPTS];
+
+    // gesture matches
+    uint32_t m_gestureCount;
+
+    // zone changes
+    uint32_t m_zoneEnters, m_zoneExits;
+};
+
+// Rotates an ambisonic signal by the sensor orientation
+struct BNORotate : public Unit {
+    BNO_Service* service;
+
+    int order;
+    uint64_t m_frameTime; // of the frame the matrix was built from
+    bool m_ramp; // interpolate to m_matrix over this block
+    float m_matrix[BNO_HOA_MATRIX_SIZE];
+    float m_target[BNO_HOA_MATRIX_SIZE]; // of the latest frame
+    float m_slope[BNO_HOA_MATRIX_SIZE]; // per sample, while ramping
+};
 
-    unsigned int readInterval; // read interval in ms
-    std::thread* thread;
-    volatile int threadShouldStop;
+// Writes frames to control buses, for any number of synths to read
+struct BNOBus : public Unit {
+    BNO_Service* service;
+    uint64_t m_frameTime; // of the last frame written
 };
 
-bnoState_t gData = {
-	{0.0}, {0.0}, {0.0},
-	{0.0}, {0.0}, {0.0},
-	{0.0}, {0.0}, {0.0},
-	{0.0}, {0.0}, {0.0} };
+// Appends every frame to a Buffer, as a circular history
+struct BNOHistory : public Unit {
+    BNO_Service* service;
+    float m_fbufnum;
+    SndBuf* m_buf;
+    uint32_t m_next; // next history frame to write
+    uint32_t m_writePos; // next Buffer frame
+};
+
+// The device service outlives units, it is stopped when the plugin is unloaded
+static BNO_Service gService;
+
+// Payload of the asynchronous acquire/release commands
+typedef struct {
+    BNO_Service* service;
+} bnoServiceCmd_t;
 
 enum bnoChannel {
     CH_ACC,
     CH_GYR,
     CH_MAG,
-    CH_ORI
+    CH_ORI,
+    CH_CAL,
+    CH_FEAT,
+    CH_ONSET,
+    CH_INT,
+    CH_GESTURE,
+    CH_ZONE,
+    CH_TEMPO
 };
 
+// Time for an onset to be detected and reach the unit, on top of a block, in us
+#define BNO_ONSET_LATENCY 1000
+
 void BNO_Ctor(BNO *unit);
 void BNO_Dtor(BNO *unit);
 void BNO_next_k(BNO *unit, int numSamples);
+void BNO_next_a(BNO *unit, int numSamples);
 
-static void updateBNO(BNO* unit) {
+static bool acquireService(World*, void* data) {
+    static_cast<bnoServiceCmd_t*>(data)->service->acquire();
+    return true;
+}
 
-    while(!unit->threadShouldStop && !Bela_stopRequested()) {
-        if (unit->currentTask == TASK_RUN) {
-            unit->bno->readIMU(gData);
-        } else {
+static bool releaseService(World*, void* data) {
+    static_cast<bnoServiceCmd_t*>(data)->service->release();
+    return true;
+}
 
-            char calibrationPath[128];
-            snprintf(calibrationPath, 127, "%s/.bnoCalibration", getenv("HOME"));
-            bnoCalibration_t calData;
-            FILE *fp;
-            switch ( unit->currentTask ) {
-            case TASK_CALIBRATE_IDLE:
-                break;
-
-            case TASK_CALIBRATE_1:
-                printf("BNO: Calibrating, neutral position\n");
-                unit->bno->getNeutralGravity();
-                unit->currentTask = TASK_CALIBRATE_IDLE;
-                break;
-
-            case TASK_CALIBRATE_2:
-                printf("BNO: Calibrating, tilted down\n");
-                unit->bno->getDownGravity();
-                unit->bno->recalcCalibration();
-                printf("Done, running\n");
-                unit->currentTask = TASK_RUN;
-                break;
-            case TASK_SAVE:
-                Print("Saving calibration\n");
-                fp = fopen(calibrationPath, "wb+");
-                if (fp != NULL) {
-                    unit->bno->getCalibration(calData);
-                    fwrite(&calData, sizeof(bnoCalibration_t), 1, fp);
-                    fclose(fp);
-                } else {
-                    printf("BNO: Couldn't open file for writing\n");
-                }
-                unit->currentTask = TASK_RUN;
-                break;
-
-            case TASK_LOAD:
-                Print("Loading calibration\n");
-                fp = fopen(calibrationPath, "rb");
-                if (fp != NULL) {
-                    fread(&(calData), sizeof(bnoCalibration_t), 1, fp);
-                    fclose(fp);
-                    unit->bno->setCalibration(calData);
-                    unit->bno->recalcCalibration();
-                } else {
-                    printf("BNO: Couldn't open file for reading\n");
-                }
-                unit->currentTask = TASK_RUN;
-                break;
-            }
-        }
-        usleep(unit->readInterval);
+static void freeServiceCmd(World* world, void* data) {
+    RTFree(world, data);
+}
+
+// Run fn for the service on the non-realtime thread
+static void serviceCommand(World* world, BNO_Service* service, AsyncStageFn fn) {
+    bnoServiceCmd_t* cmd = (bnoServiceCmd_t*)RTAlloc(world, sizeof(bnoServiceCmd_t));
+    if (cmd == NULL) {
+        return;
     }
+    cmd->service = service;
+    DoAsynchronousCommand(world, 0, "", cmd, fn, 0, 0, freeServiceCmd, 0, 0);
 }
 
 void BNO_Ctor(BNO *unit) {
     unit->channel = static_cast<int>(IN0(0));
-    unit->outputs = 3;
+    unit->outputs = sc_min((int)unit->mNumOutputs, (int)BNO_NUM_FEATURES);
     unit->m_caltrig = 0.f;
     unit->m_savetrig = 0.f;
     unit->m_loadtrig = 0.f;
+    unit->m_pendingCal = unit->m_pendingLoad = unit->m_pendingSave = 0;
+    unit->m_triggers = true;
+
+    unit->m_onsetSeen = false;
+    unit->m_onsetPending = false;
+    unit->m_onsetCount = 0;
+    unit->m_onsetDue = unit->m_lastOnset = 0;
+    unit->m_onsetStrength = unit->m_onsetInterval = 0.f;
+    unit->m_intSeen = false;
+    unit->m_gestureCount = gService.gestureCount();
+    unit->m_zoneEnters = gService.zoneEnters();
+    unit->m_zoneExits = gService.zoneExits();
+    // A block plus the time to read the sensor, so onsets are never late
+    unit->m_onsetLatency = (uint64_t)(FULLBUFLENGTH * 1e6 / FULLRATE) + BNO_ONSET_LATENCY;
+
+    // Device setup and the reader thread are started from the NRT thread,
+    // outputs stay at zero until the service is running
+    unit->service = &gService;
+    serviceCommand(unit->mWorld, unit->service, acquireService);
+    if (unit->channel == CH_TEMPO) {
+        // inputs 5 and 6 are the tempo range
+        bnoCommand_t cmd = { CMD_TEMPO, 0, { 0.f, 0.f, 0.f } };
+        if (unit->mNumInputs > 6) {
+            cmd.param[0] = IN0(5);
+            cmd.param[1] = IN0(6);
+        }
+        unit->service->push(cmd);
+    }
 
-    unit->bno = new SC_BNO055();
-
-    if ( unit->bno->setup() ) {
-        unit->currentTask = TASK_LOAD;
+    if (unit->mCalcRate == calc_FullRate) {
+        SETCALC(BNO_next_a);
+        BNO_next_a(unit, 1);
     } else {
-		printf("Error initialising BNO055\n");
-        unit->currentTask = TASK_STOP;
+        SETCALC(BNO_next_k);
+        BNO_next_k(unit, 1);
     }
+    // A constant trigger input fires once, in the first calculation above
+    // if it is nonzero, so after that only changing ones are polled
+    unit->m_triggers = INRATE(1) != calc_ScalarRate || INRATE(2) != calc_ScalarRate
+        || INRATE(3) != calc_ScalarRate;
+}
+
+void BNO_Dtor(BNO* unit) {
+    serviceCommand(unit->mWorld, unit->service, releaseService);
+}
 
-    SETCALC(BNO_next_k);
-    BNO_next_k(unit, 1);
+// Queue count commands of type, returns the number that didn't fit
+static int pushCommands(BNO *unit, int type, int count, int arg = 0) {
+    bnoCommand_t cmd = { type, arg, { 0.f, 0.f, 0.f } };
+    while (count > 0 && unit->service->push(cmd)) {
+        --count;
+    }
+    return count;
+}
 
-    unit->readInterval = 50; //microseconds
-    unit->threadShouldStop = 0;
-    unit->thread = new std::thread(updateBNO, unit);
+// Count rising edges of a trigger input. Control rate inputs of an audio
+// rate unit only have one value per block.
+static int countTriggers(BNO *unit, int input, float &prevtrig, int numSamples) {
+    float* in = ZIN(input);
+    int count = 0;
+    if (INRATE(input) != calc_FullRate) {
+        numSamples = 1;
+    }
+    for (int i = 0; i < numSamples; ++i) {
+        float trig = ZXP(in);
+        if (trig > 0.f && prevtrig <= 0.f) {
+            count++;
+        }
+        prevtrig = trig;
+    }
+    return count;
 }
 
-void BNO_Dtor(BNO* unit) {
-  if(unit->thread && unit->thread->joinable())
-  {
-    unit->threadShouldStop = 1;
-    unit->thread->join();
-  }
-  delete unit->thread;
-  delete unit->bno;
+// Handle the trigger inputs and pick up service events
+static void BNO_control(BNO *unit, int numSamples) {
+    if (unit->m_triggers) {
+        int calibrations = countTriggers(unit, 1, unit->m_caltrig, numSamples);
+        if (calibrations > 0) {
+            bnoLog(BNO_LOG_CALIBRATE, calibrations);
+        }
+        unit->m_pendingCal += calibrations;
+        unit->m_pendingLoad += countTriggers(unit, 2, unit->m_loadtrig, numSamples);
+        unit->m_pendingSave += countTriggers(unit, 3, unit->m_savetrig, numSamples);
+    }
+
+    // Anything that doesn't fit is retried next block, so no trigger is lost
+    if (unit->m_pendingCal + unit->m_pendingSave + unit->m_pendingLoad > 0) {
+        unit->m_pendingCal = pushCommands(unit, CMD_CALIBRATE, unit->m_pendingCal);
+        // SynthDefs from before the profile input use profile 0
+        int profile = unit->mNumInputs > 4 ? static_cast<int>(IN0(4)) : 0;
+        unit->m_pendingSave = pushCommands(unit, CMD_SAVE, unit->m_pendingSave, profile);
+        unit->m_pendingLoad = pushCommands(unit, CMD_LOAD, unit->m_pendingLoad, profile);
+    }
+
+    unit->service->update(unit->mWorld->mBufCounter);
+}
+
+// Sample offset in this block of an onset that is due, -1 if there is none.
+// Onsets are played a fixed latency after they happened, which keeps the
+// timing between them.
+static int onsetOffset(BNO *unit, const bnoFrame_t &frame) {
+    // don't fire onsets from before the unit started
+    if (!unit->m_onsetSeen) {
+        unit->m_onsetSeen = true;
+        unit->m_onsetCount = frame.onsetCount;
+        unit->m_lastOnset = frame.onsetTime;
+        return -1;
+    }
+    if (frame.onsetCount != unit->m_onsetCount) {
+        unit->m_onsetCount = frame.onsetCount;
+        unit->m_onsetDue = frame.onsetTime + unit->m_onsetLatency;
+        unit->m_onsetStrength = frame.onsetStrength;
+        unit->m_onsetInterval = unit->m_lastOnset > 0 ? (frame.onsetTime - unit->m_lastOnset) * 1e-6f : 0.f;
+        unit->m_lastOnset = frame.onsetTime;
+        unit->m_onsetPending = true;
+    }
+    if (!unit->m_onsetPending) {
+        return -1;
+    }
+
+    int64_t wait = (int64_t)(unit->m_onsetDue - bnoTimeUs());
+    int offset = (int)(wait * 1e-6 * FULLRATE);
+    if (offset >= FULLBUFLENGTH) {
+        return -1;
+    }
+    unit->m_onsetPending = false;
+    return sc_max(offset, 0);
+}
+
+// Number of values of a channel that comes straight from the frame
+static int frameChannelSize(int channel) {
+    switch (channel) {
+    case CH_ACC:
+    case CH_GYR:
+    case CH_MAG:
+    case CH_ORI:
+        return 3;
+    case CH_FEAT:
+        return BNO_NUM_FEATURES;
+    default:
+        return 0;
+    }
+}
+
+// Values of a channel that come straight from the frame, scaled once per
+// block here since frames are published raw. Returns the number of values,
+// 0 for channels that are not part of the frame.
+static int frameValues(const bnoFrame_t &frame, int channel, float *values) {
+    switch (channel) {
+    case CH_ACC:
+        bnoScaleValues(frame.accel, values, 3, BNO_ACCEL);
+        return 3;
+    case CH_GYR:
+        bnoScaleValues(frame.gyro, values, 3, BNO_GYRO);
+        return 3;
+    case CH_MAG:
+        bnoScaleValues(frame.mag, values, 3, BNO_MAG);
+        return 3;
+    case CH_ORI:
+        float ypr[3];
+        bnoQuatToEuler(frame.quat, ypr);
+        values[0] = ypr[1]; // pitch
+        values[1] = ypr[2]; // roll
+        values[2] = ypr[0]; // yaw
+        return 3;
+    case CH_FEAT:
+        memcpy(values, frame.features, sizeof(frame.features));
+        return BNO_NUM_FEATURES;
+    default:
+        return 0;
+    }
+}
+
+// Values of the unit's channel for the latest frame. Returns false if no
+// new values could be read, outputs keep their values then.
+static bool BNO_values(BNO *unit, float *values, int &onset) {
+    onset = -1;
+    if (!unit->service->running()) {
+        //Zero outputs until the device is running
+        for (int o = 0; o < unit->outputs; o++) {
+            values[o] = 0.f;
+        }
+        return true;
+    }
+
+    bnoFrame_t frame;
+    if (!bnoRead(unit->service->state(), frame)) {
+        return false;
+    }
+
+    if (frameValues(frame, unit->channel, values) > 0) {
+        return true;
+    }
+    switch (unit->channel) {
+    case CH_CAL:
+        values[0] = unit->service->calibrationStep();
+        values[1] = unit->service->calibrationProgress();
+        values[2] = unit->service->calibrationQuality();
+        break;
+    case CH_ONSET:
+        onset = onsetOffset(unit, frame);
+        values[0] = onset >= 0 ? 1.f : 0.f;
+        values[1] = unit->m_onsetStrength;
+        values[2] = unit->m_onsetInterval;
+        break;
+    case CH_INT:
+        // a trigger for each interrupt that fired since the last block
+        for (int i = 0; i < BNO_NUM_INTERRUPTS; ++i) {
+            values[i] = (unit->m_intSeen && frame.interruptCounts[i] != unit->m_intCounts[i]) ? 1.f : 0.f;
+        }
+        memcpy(unit->m_intCounts, frame.interruptCounts, sizeof(unit->m_intCounts));
+        unit->m_intSeen = true;
+        break;
+    case CH_GESTURE: {
+        uint32_t count = unit->service->gestureCount();
+        values[0] = count != unit->m_gestureCount ? 1.f : 0.f;
+        values[1] = unit->service->gestureId();
+        values[2] = unit->service->gestureConfidence();
+        unit->m_gestureCount = count;
+        break;
+    }
+    case CH_ZONE: {
+        uint32_t enters = unit->service->zoneEnters();
+        uint32_t exits = unit->service->zoneExits();
+        values[0] = enters != unit->m_zoneEnters ? 1.f : 0.f;
+        values[1] = exits != unit->m_zoneExits ? 1.f : 0.f;
+        values[2] = unit->service->activeZone();
+        unit->m_zoneEnters = enters;
+        unit->m_zoneExits = exits;
+        break;
+    }
+    case CH_TEMPO: {
+        // the phase moves on between estimates
+        const bnoTempo_t &tempo = unit->service->tempo();
+        float phase = tempo.phase + (int64_t)(bnoTimeUs() - tempo.time) * 1e-6f * tempo.bpm / 60.f;
+        values[0] = tempo.bpm;
+        values[1] = tempo.confidence;
+        values[2] = phase - floorf(phase);
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
 }
 
 void BNO_next_k(BNO *unit, int numSamples) {
+    BNO_control(unit, numSamples);
 
-    float trig;
-    float* calInput = ZIN(1);
-    float* loadInput = ZIN(2);
-    float* saveInput = ZIN(3);
-    float cal_prevtrig = unit->m_caltrig;
-    float load_prevtrig = unit->m_loadtrig;
-    float save_prevtrig = unit->m_savetrig;
-
-    //If we're currently not in a command, check for command triggers
-    if ((unit->currentTask & TASK_CMD) != TASK_CMD) {
-        //Calibration
-        for (int i = 0; i < numSamples; ++i) {
-            trig = ZXP(calInput);
-            if (trig > 0.f && cal_prevtrig <= 0.f) {
-                if (unit->currentTask == TASK_CALIBRATE_IDLE) {
-                    unit->currentTask = TASK_CALIBRATE_2;
-                    rt_printf("Calibrating, step 2\n");
-                } else {
-                    unit->currentTask = TASK_CALIBRATE_1;
-                    rt_printf("Calibrating, step 1\n");
-                }
-            }
-            cal_prevtrig = trig;
+    float values[BNO_NUM_FEATURES] = {};
+    int onset;
+    if (BNO_values(unit, values, onset)) {
+        for (int o = 0; o < unit->outputs; o++) {
+            OUT0(o) = values[o];
+        }
+    } else if (unit->channel == CH_ONSET) {
+        // triggers only last one block
+        OUT0(0) = 0.f;
+    } else if (unit->channel == CH_INT) {
+        for (int o = 0; o < unit->outputs; o++) {
+            OUT0(o) = 0.f;
+        }
+    }
+}
 
-            trig = ZXP(loadInput);
-            if (trig > 0.f && load_prevtrig <= 0.f) {
-                unit->currentTask = TASK_LOAD;
-                //call aux task here
+// Audio rate: onset triggers are single sample impulses at the onset,
+// other values are held over the block
+void BNO_next_a(BNO *unit, int numSamples) {
+    BNO_control(unit, numSamples);
+
+    float values[BNO_NUM_FEATURES] = {};
+    int onset;
+    if (!BNO_values(unit, values, onset)) {
+        // keep the last values, but never repeat an impulse
+        if (unit->channel == CH_ONSET) {
+            values[0] = 0.f;
+            values[1] = unit->m_onsetStrength;
+            values[2] = unit->m_onsetInterval;
+        } else if (unit->channel != CH_INT) {
+            for (int o = 0; o < unit->outputs; o++) {
+                values[o] = OUT(o)[numSamples - 1];
             }
-            load_prevtrig = trig;
+        }
+    }
 
-            trig = ZXP(saveInput);
-            if (trig > 0.f && save_prevtrig <= 0.f) {
-                unit->currentTask = TASK_SAVE;
-                //call aux task here
-            }
-            save_prevtrig = trig;
+    for (int o = 0; o < unit->outputs; o++) {
+        float* out = OUT(o);
+        float value = (unit->channel == CH_ONSET && o == 0) ? 0.f : values[o];
+        for (int i = 0; i < numSamples; ++i) {
+            out[i] = value;
         }
+    }
+    if (onset >= 0 && onset < numSamples) {
+        OUT(0)[onset] = 1.f;
+    }
+}
+
+
+void BNORotate_Ctor(BNORotate *unit);
+void BNORotate_Dtor(BNORotate *unit);
+void BNORotate_next(BNORotate *unit, int numSamples);
+
+void BNORotate_Ctor(BNORotate *unit) {
+    unit->service = &gService;
+    unit->m_frameTime = 0;
+    unit->m_ramp = false;
 
-        unit->m_caltrig = cal_prevtrig;
-        unit->m_loadtrig = load_prevtrig;
-        unit->m_savetrig = save_prevtrig;
+    // Input 0 is the invert flag, the rest the ambisonic channels
+    int channels = unit->mNumInputs - 1;
+    unit->order = 0;
+    for (int order = 1; order <= BNO_HOA_MAX_ORDER; ++order) {
+        if (bnoHoaChannels(order) == channels) {
+            unit->order = order;
+        }
+    }
+    if (unit->order == 0 || (int)unit->mNumOutputs != channels) {
+        Print("BNORotate: Needs 4, 9 or 16 channels (order 1 to 3), not %d\n", channels);
+        SETCALC(*ClearUnitOutputs);
+        ClearUnitOutputs(unit, 1);
+        unit->order = 0;
+        return;
+    }
+    // The channels are read a full block at a time
+    for (int c = 1; c <= channels; ++c) {
+        if (INRATE(c) != calc_FullRate) {
+            Print("BNORotate: Channel %d is not audio rate\n", c - 1);
+            SETCALC(*ClearUnitOutputs);
+            ClearUnitOutputs(unit, 1);
+            unit->order = 0;
+            return;
+        }
     }
 
-    if (unit->currentTask == TASK_RUN) {
+    // Start unrotated until the first frame arrives
+    float identity[9] = { 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f };
+    bnoHoaRotation(identity, unit->order, unit->m_matrix);
 
-        switch (unit->channel) {
-        case CH_ACC:
-            OUT0(0) = gData.ax;
-            OUT0(1) = gData.ay;
-            OUT0(2) = gData.az;
-            break;
-        case CH_GYR:
-            OUT0(0) = gData.gx;
-            OUT0(1) = gData.gy;
-            OUT0(2) = gData.gz;
-            break;
-        case CH_MAG:
-            OUT0(0) = gData.mx;
-            OUT0(1) = gData.my;
-            OUT0(2) = gData.mz;
+    serviceCommand(unit->mWorld, unit->service, acquireService);
+    SETCALC(BNORotate_next);
+    BNORotate_next(unit, 1);
+}
+
+void BNORotate_Dtor(BNORotate *unit) {
+    if (unit->order > 0) {
+        serviceCommand(unit->mWorld, unit->service, releaseService);
+    }
+}
+
+// Build the matrix for a new frame, once per sensor frame rather than per
+// block. The block ramps from the current matrix to the new one.
+static void BNORotate_update(BNORotate *unit, int numSamples) {
+    unit->service->update(unit->mWorld->mBufCounter);
+    unit->m_ramp = false;
+
+    bnoFrame_t frame;
+    if (!unit->service->running() || !bnoRead(unit->service->state(), frame)
+            || frame.time == unit->m_frameTime) {
+        return;
+    }
+    unit->m_frameTime = frame.time;
+
+    const float scale = bnoScale[BNO_QUAT];
+    bnoQuatf_t q = { frame.quat[0] * scale, frame.quat[1] * scale, frame.quat[2] * scale, frame.quat[3] * scale };
+    float norm = sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    if (norm < 0.5f) {
+        return;
+    }
+    // Head tracking counter-rotates the scene, so sources stay in place
+    float sign = IN0(0) > 0.f ? -1.f : 1.f;
+    q.w /= norm;
+    q.x *= sign / norm;
+    q.y *= sign / norm;
+    q.z *= sign / norm;
+
+    float r[9];
+    bnoQuatToMatrix(q, r);
+    bnoHoaRotation(r, unit->order, unit->m_target);
+
+    int size = bnoHoaMatrixSize(unit->order);
+    float step = 1.f / numSamples;
+    for (int i = 0; i < size; ++i) {
+        unit->m_slope[i] = (unit->m_target[i] - unit->m_matrix[i]) * step;
+    }
+    unit->m_ramp = true;
+}
+
+// out (+)= (a + slope * (i + 1)) * in. Kept free of aliasing and
+// dependencies between samples, so the loops vectorize.
+template <bool Accumulate, bool Ramp>
+static inline void rotateKernel(float* __restrict out, const float* __restrict in, float a, float slope, int numSamples) {
+    for (int i = 0; i < numSamples; ++i) {
+        float c = Ramp ? a + slope * (float)(i + 1) : a;
+        out[i] = Accumulate ? out[i] + c * in[i] : c * in[i];
+    }
+}
+
+// One block of the matrix, rows and columns are the channels of order l
+template <bool Ramp>
+static void rotateBlock(BNORotate *unit, int l, int numSamples) {
+    const int size = 2 * l + 1;
+    const int first = l * l;
+    const float *matrix = unit->m_matrix + bnoHoaBlockOffset(l);
+    const float *slope = unit->m_slope + bnoHoaBlockOffset(l);
+
+    for (int row = 0; row < size; ++row) {
+        float *out = OUT(first + row);
+        const float *a = matrix + row * size;
+        const float *d = slope + row * size;
+        rotateKernel<false, Ramp>(out, IN(1 + first), a[0], d[0], numSamples);
+        for (int col = 1; col < size; ++col) {
+            rotateKernel<true, Ramp>(out, IN(1 + first + col), a[col], d[col], numSamples);
+        }
+    }
+}
+
+void BNORotate_next(BNORotate *unit, int numSamples) {
+    BNORotate_update(unit, numSamples);
+
+    // order 0 is not affected by rotation
+    memcpy(OUT(0), IN(1), numSamples * sizeof(float));
+    for (int l = 1; l <= unit->order; ++l) {
+        if (unit->m_ramp) {
+            rotateBlock<true>(unit, l, numSamples);
+        } else {
+            rotateBlock<false>(unit, l, numSamples);
+        }
+    }
+
+    if (unit->m_ramp) {
+        memcpy(unit->m_matrix, unit->m_target, bnoHoaMatrixSize(unit->order) * sizeof(float));
+    }
+}
+
+void BNOBus_Ctor(BNOBus *unit);
+void BNOBus_Dtor(BNOBus *unit);
+void BNOBus_next(BNOBus *unit, int numSamples);
+
+void BNOBus_Ctor(BNOBus *unit) {
+    unit->service = &gService;
+    unit->m_frameTime = 0;
+    serviceCommand(unit->mWorld, unit->service, acquireService);
+    SETCALC(BNOBus_next);
+}
+
+void BNOBus_Dtor(BNOBus *unit) {
+    serviceCommand(unit->mWorld, unit->service, releaseService);
+}
+
+// Input 0 is the first control bus, the rest are channels, written one
+// after the other. Buses only change when there is a new frame, at the
+// start of the block, so synths after this one see the whole frame.
+void BNOBus_next(BNOBus *unit, int) {
+    unit->service->update(unit->mWorld->mBufCounter);
+
+    bnoFrame_t frame;
+    if (!unit->service->running() || !bnoRead(unit->service->state(), frame)
+            || frame.time == unit->m_frameTime) {
+        return;
+    }
+    unit->m_frameTime = frame.time;
+
+    World *world = unit->mWorld;
+    int bus = static_cast<int>(IN0(0));
+    for (uint32 i = 1; i < unit->mNumInputs; ++i) {
+        float values[BNO_NUM_FEATURES];
+        int count = frameValues(frame, static_cast<int>(IN0(i)), values);
+        if (bus < 0 || bus + count > world->mNumControlBusChannels) {
             break;
-        case CH_ORI:
-            OUT0(0) = gData.pitch;
-            OUT0(1) = gData.roll;
-            OUT0(2) = gData.yaw;
+        }
+        for (int k = 0; k < count; ++k) {
+            world->mControlBus[bus + k] = values[k];
+            world->mControlBusTouched[bus + k] = world->mBufCounter;
+        }
+        bus += count;
+    }
+}
+
+void BNOHistory_Ctor(BNOHistory *unit);
+void BNOHistory_Dtor(BNOHistory *unit);
+void BNOHistory_next(BNOHistory *unit, int numSamples);
+
+void BNOHistory_Ctor(BNOHistory *unit) {
+    unit->service = &gService;
+    unit->m_fbufnum = -1e9f;
+    unit->m_buf = NULL;
+    unit->m_next = gService.historyCount();
+    unit->m_writePos = 0;
+    serviceCommand(unit->mWorld, unit->service, acquireService);
+    SETCALC(BNOHistory_next);
+    OUT0(0) = 0.f;
+}
+
+void BNOHistory_Dtor(BNOHistory *unit) {
+    serviceCommand(unit->mWorld, unit->service, releaseService);
+}
+
+// Input 0 is the Buffer, the rest are channels. Each sensor frame is one
+// Buffer frame with the values of all channels, so the Buffer needs as many
+// channels as there are values. The frames of a block are written one after
+// the other, to one region of the Buffer that wraps at most once.
+void BNOHistory_next(BNOHistory *unit, int) {
+    unit->service->update(unit->mWorld->mBufCounter);
+
+    GET_BUF
+    uint32 rowSize = 0;
+    for (uint32 i = 1; i < unit->mNumInputs; ++i) {
+        rowSize += frameChannelSize(static_cast<int>(IN0(i)));
+    }
+
+    uint32_t count = unit->service->historyCount();
+    if (bufData == NULL || bufFrames == 0 || bufChannels != rowSize || !unit->service->running()) {
+        unit->m_next = count;
+        OUT0(0) = unit->m_writePos;
+        return;
+    }
+    // frames that have been overwritten in the meantime are skipped
+    if (count - unit->m_next > BNO_HISTORY_SIZE) {
+        unit->m_next = count - BNO_HISTORY_SIZE;
+    }
+    if (unit->m_writePos >= bufFrames) {
+        unit->m_writePos = 0;
+    }
+
+    bnoFrame_t frame;
+    for (; unit->m_next != count; ++unit->m_next) {
+        if (!unit->service->historyFrame(unit->m_next, frame)) {
+            continue;
+        }
+        float *row = bufData + unit->m_writePos * bufChannels;
+        for (uint32 i = 1; i < unit->mNumInputs; ++i) {
+            row += frameValues(frame, static_cast<int>(IN0(i)), row);
+        }
+        if (++unit->m_writePos == bufFrames) {
+            unit->m_writePos = 0;
+        }
+    }
+    OUT0(0) = unit->m_writePos;
+}
+
+// Zone commands, run on the realtime thread like units
+// /cmd bnoZoneCap zone azimuth elevation radius
+static void cmdZoneCap(World*, void*, struct sc_msg_iter* args, void*) {
+    bnoCommand_t cmd = { CMD_ZONE_CAP, args->geti(), { 0.f, 0.f, 0.f } };
+    for (int i = 0; i < 3; ++i) {
+        cmd.param[i] = args->getf();
+    }
+    if (!gService.push(cmd)) {
+        bnoLog(BNO_LOG_ZONE_DROPPED, cmd.arg);
+    }
+}
+
+// /cmd bnoZonePolygon zone azimuth elevation azimuth elevation ...
+// Vertices past BNO_ZONE_MAX_VERTICES are ignored by the zones; here one
+// is only lost if the command queue is full.
+static void cmdZonePolygon(World*, void*, struct sc_msg_iter* args, void*) {
+    bnoCommand_t cmd = { CMD_ZONE_CLEAR, args->geti(), { 0.f, 0.f, 0.f } };
+    if (!gService.push(cmd)) {
+        bnoLog(BNO_LOG_ZONE_DROPPED, cmd.arg);
+        return;
+    }
+    cmd.type = CMD_ZONE_VERTEX;
+    while (args->remain() > 0) {
+        cmd.param[0] = args->getf();
+        cmd.param[1] = args->getf();
+        if (!gService.push(cmd)) {
+            bnoLog(BNO_LOG_ZONE_DROPPED, cmd.arg);
             break;
         }
+    }
+}
 
+// /cmd bnoZoneClear zone, -1 for all
+static void cmdZoneClear(World*, void*, struct sc_msg_iter* args, void*) {
+    bnoCommand_t cmd = { CMD_ZONE_CLEAR, args->geti(-1), { 0.f, 0.f, 0.f } };
+    if (!gService.push(cmd)) {
+        bnoLog(BNO_LOG_ZONE_DROPPED, cmd.arg);
+    }
+}
 
-    } else {
-        //Zero outputs while doing calibration
-        for (int o = 0; o < 3; o++) {
-            OUT0(o) = 0.f;
+// Configuration commands. They run on the reader thread while the NRT
+// thread waits, and /done name is sent back once a command has run, so
+// clients can sync on it. Failures are posted instead.
+typedef struct {
+    const char* name;
+    int type;
+    bool hasArg; // the first argument is the command arg, the rest are params
+} bnoConfigCmd_t;
+
+static const bnoConfigCmd_t gConfigCmds[] = {
+    { "bnoSetRate", CMD_SET_RATE, true },           // read interval in us
+    { "bnoSetMode", CMD_SET_MODE, true },           // operating mode
+    { "bnoSetCapture", CMD_SET_CAPTURE, true },     // calibration capture window in ms
+    { "bnoSetFilter", CMD_SET_FILTER, true },       // value type, filter type, cutoff, parameter
+    { "bnoSetOnset", CMD_SET_ONSET, false },        // sensitivity, minimum jerk, refractory period in ms
+    { "bnoSetInterrupt", CMD_SET_INTERRUPT, true }, // interrupt, threshold, duration, axes
+    { "bnoDrift", CMD_DRIFT, true },                // 1 on, 0 off
+    { "bnoMagFit", CMD_MAG_FIT, true },             // 1 start, 0 stop, -1 stop and clear
+    { "bnoCalibrate", CMD_CALIBRATE, true },        // step, 0 for the next
+    { "bnoLoad", CMD_LOAD, true },                  // profile
+    { "bnoSave", CMD_SAVE, true },                  // profile
+    { "bnoGestureRecord", CMD_GESTURE_RECORD, true },       // template
+    { "bnoGestureStop", CMD_GESTURE_STOP, false },          // keeps the recorded template
+    { "bnoGestureClear", CMD_GESTURE_CLEAR, true },         // template, -1 for all
+    { "bnoGestureThreshold", CMD_GESTURE_THRESHOLD, false },// match threshold
+};
+
+typedef struct {
+    const char* name;
+    bnoCommand_t cmd;
+    char path[256];
+} bnoRequestCmd_t;
+
+static bool runRequest(World*, void* data) {
+    bnoRequestCmd_t* request = static_cast<bnoRequestCmd_t*>(data);
+    if (!gService.started()) {
+        Print("BNO: %s failed, the sensor isn't running (start a BNO synth first)\n", request->name);
+        return false;
+    }
+    if (!gService.request(request->cmd, request->path)) {
+        if (request->path[0] != '\0') {
+            Print("BNO: %s %s failed\n", request->name, request->path);
+        } else {
+            Print("BNO: %s failed\n", request->name);
         }
+        return false;
+    }
+    return true;
+}
 
+static void sendRequest(World* world, void* replyAddr, const char* name, const bnoCommand_t& cmd, const char* path) {
+    bnoRequestCmd_t* request = (bnoRequestCmd_t*)RTAlloc(world, sizeof(bnoRequestCmd_t));
+    if (request == NULL) {
+        Print("BNO: %s failed, out of memory\n", name);
+        return;
+    }
+    request->name = name;
+    request->cmd = cmd;
+    request->path[0] = '\0';
+    if (path != NULL) {
+        strncpy(request->path, path, sizeof(request->path) - 1);
+        request->path[sizeof(request->path) - 1] = '\0';
     }
+    DoAsynchronousCommand(world, replyAddr, name, request, runRequest, 0, 0, freeServiceCmd, 0, 0);
 }
 
+// /cmd bnoSetRate 10000 and the others in gConfigCmds
+static void cmdConfigure(World* world, void* userData, struct sc_msg_iter* args, void* replyAddr) {
+    const bnoConfigCmd_t* config = static_cast<const bnoConfigCmd_t*>(userData);
+    bnoCommand_t cmd = { config->type, 0, { 0.f, 0.f, 0.f } };
+    if (config->hasArg) {
+        cmd.arg = args->geti();
+    }
+    for (int i = 0; i < 3; ++i) {
+        cmd.param[i] = args->getf();
+    }
+    sendRequest(world, replyAddr, config->name, cmd, NULL);
+}
+
+// /cmd bnoRecord path starts recording the stream, /cmd bnoRecord stops
+static void cmdRecord(World* world, void*, struct sc_msg_iter* args, void* replyAddr) {
+    const char* path = args->gets();
+    bnoCommand_t cmd = { CMD_RECORD, path != NULL && path[0] != '\0', { 0.f, 0.f, 0.f } };
+    sendRequest(world, replyAddr, "bnoRecord", cmd, path);
+}
+
+// Unit commands take the place of the trigger inputs:
+// /u_cmd node unit calibrate [step], load profile, save profile, and for
+// gestures gestureRecord template, gestureStop, gestureClear template and
+// gestureThreshold threshold.
+// The reply /bno/<command> node -1 arg queued tells whether the command
+// was queued; it is 0 if the command queue was full.
+static void sendUnitCommand(BNO* unit, const char* reply, const bnoCommand_t& cmd, float arg) {
+    float values[2] = { arg, unit->service->push(cmd) ? 1.f : 0.f };
+    SendNodeReply(&unit->mParent->mNode, -1, reply, 2, values);
+}
+
+static void unitCommand(BNO* unit, const char* reply, int type, int arg) {
+    bnoCommand_t cmd = { type, arg, { 0.f, 0.f, 0.f } };
+    sendUnitCommand(unit, reply, cmd, (float)arg);
+}
+
+static void BNO_calibrate(BNO* unit, struct sc_msg_iter* args) {
+    unitCommand(unit, "/bno/calibrate", CMD_CALIBRATE, args->geti());
+}
+
+static void BNO_load(BNO* unit, struct sc_msg_iter* args) {
+    unitCommand(unit, "/bno/load", CMD_LOAD, args->geti());
+}
+
+static void BNO_save(BNO* unit, struct sc_msg_iter* args) {
+    unitCommand(unit, "/bno/save", CMD_SAVE, args->geti());
+}
+
+static void BNO_gestureRecord(BNO* unit, struct sc_msg_iter* args) {
+    unitCommand(unit, "/bno/gestureRecord", CMD_GESTURE_RECORD, args->geti());
+}
+
+static void BNO_gestureStop(BNO* unit, struct sc_msg_iter*) {
+    unitCommand(unit, "/bno/gestureStop", CMD_GESTURE_STOP, 0);
+}
+
+static void BNO_gestureClear(BNO* unit, struct sc_msg_iter* args) {
+    unitCommand(unit, "/bno/gestureClear", CMD_GESTURE_CLEAR, args->geti(-1));
+}
+
+static void BNO_gestureThreshold(BNO* unit, struct sc_msg_iter* args) {
+    float threshold = args->getf(0.25f);
+    bnoCommand_t cmd = { CMD_GESTURE_THRESHOLD, 0, { threshold, 0.f, 0.f } };
+    sendUnitCommand(unit, "/bno/gestureThreshold", cmd, threshold);
+}
 
 PluginLoad(BNO)
 {
 
     ft = inTable;
+    bnoLogStart();
+
+    char calibrationPath[1024];
+    snprintf(calibrationPath, sizeof(calibrationPath), "%s/.bnoCalibration", getenv("HOME"));
+    gService.loadProfiles(calibrationPath);
+    // Frames are published to other processes from server start, whether
+    // or not a synth uses the sensor. This user is never released.
+    if (getenv("BNO_SHM") != NULL || getenv("BNO_OSC") != NULL) {
+        gService.acquire();
+    }
 
 
     DefineDtorCantAliasUnit(BNO);
+    DefineDtorCantAliasUnit(BNORotate);
+    DefineDtorUnit(BNOBus);
+    DefineDtorUnit(BNOHistory);
+
+    DefinePlugInCmd("bnoZoneCap", cmdZoneCap, 0);
+    DefinePlugInCmd("bnoZonePolygon", cmdZonePolygon, 0);
+    DefinePlugInCmd("bnoZoneClear", cmdZoneClear, 0);
+
+    for (const bnoConfigCmd_t& config : gConfigCmds) {
+        DefinePlugInCmd(config.name, cmdConfigure, (void*)&config);
+    }
+    DefinePlugInCmd("bnoRecord", cmdRecord, 0);
+
+    DefineUnitCmd("BNO", "calibrate", BNO_calibrate);
+    DefineUnitCmd("BNO", "load", BNO_load);
+    DefineUnitCmd("BNO", "save", BNO_save);
+    DefineUnitCmd("BNO", "gestureRecord", BNO_gestureRecord);
+    DefineUnitCmd("BNO", "gestureStop", BNO_gestureStop);
+    DefineUnitCmd("BNO", "gestureClear", BNO_gestureClear);
+    DefineUnitCmd("BNO", "gestureThreshold", BNO_gestureThreshold);
 }
@@ -5,36 +5,253 @@ BNO : MultiOutUGen {
     1: Gyro (xyz)
     2: Mag (xyz)
     3: Orientation (Roll, Pitch, Yaw)
+    4: Calibration (step, progress, quality)
+    5: Features (angular speed, linear acceleration, jerk, tilt, activity)
+    6: Onsets (trigger, strength, interval)
+    7: Chip interrupts (any motion, no motion, high-g, high rate triggers)
+    8: Gestures (trigger, template, confidence)
+    9: Zones (enter trigger, exit trigger, active zone)
+    10: Tempo (bpm, confidence, phase)
     */
     *kr {
-		arg channel = 0, calibrate = 0, load = 0, save = 0;
+		arg channel = 0, calibrate = 0, load = 0, save = 0, profile = 0;
 
-        ^this.multiNew('control', channel, calibrate, load, save)
+        ^this.multiNew('control', channel, calibrate, load, save, profile)
+    }
+
+    *ar {
+		arg channel = 0, calibrate = 0, load = 0, save = 0, profile = 0;
+
+        ^this.multiNew('audio', channel, calibrate, load, save, profile)
     }
 
 	init {|...theInputs|
 		inputs = theInputs;
-		^this.initOutputs(3, rate);
+		^this.initOutputs(inputs[0].switch(5, { 5 }, 7, { 4 }, { 3 }), rate);
 	}
 
     *accelKr {
-        arg calibrate = 0, load = 0, save = 0;
-        ^this.kr(0, calibrate, load, save);
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(0, calibrate, load, save, profile);
     }
 
     *gyroKr {
-        arg calibrate = 0, load = 0, save = 0;
-        ^this.kr(1, calibrate, load, save);
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(1, calibrate, load, save, profile);
     }
 
     *magKr {
-        arg calibrate = 0, load = 0, save = 0;
-        ^this.kr(2, calibrate, load, save);
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(2, calibrate, load, save, profile);
     }
 
     *orientationKr {
-        arg calibrate = 0, load = 0, save = 0;
-        ^this.kr(3, calibrate, load, save);
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(3, calibrate, load, save, profile);
+    }
+
+    *calibrationKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(4, calibrate, load, save, profile);
+    }
+
+    *featuresKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(5, calibrate, load, save, profile);
+    }
+
+    *onsetKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(6, calibrate, load, save, profile);
+    }
+
+    *onsetAr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.ar(6, calibrate, load, save, profile);
+    }
+
+    *interruptKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(7, calibrate, load, save, profile);
+    }
+
+    *gestureKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(8, calibrate, load, save, profile);
+    }
+
+    *zoneKr {
+        arg calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.kr(9, calibrate, load, save, profile);
+    }
+
+    *tempoKr {
+        arg minBpm = 40, maxBpm = 240, calibrate = 0, load = 0, save = 0, profile = 0;
+        ^this.multiNew('control', 10, calibrate, load, save, profile, minBpm, maxBpm)
+    }
+
+    // Zones are directions of the forward axis, in degrees. Azimuth is
+    // counterclockwise (to the left), elevation is up.
+    *setZoneCap {
+        arg zone, azimuth, elevation, radius, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoZoneCap, zone, azimuth, elevation, radius);
+    }
+
+    // vertices: [azimuth, elevation] pairs in order around the polygon
+    *setZonePolygon {
+        arg zone, vertices, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoZonePolygon, zone, *vertices.flat);
+    }
+
+    *clearZone {
+        arg zone = -1, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoZoneClear, zone);
+    }
+
+    // Runtime configuration. The server replies /done with the command
+    // name once the command has run on the sensor thread. The sensor must
+    // have been started by a BNO UGen.
+    *setRate {
+        arg interval, server; // microseconds between reads
+        (server ? Server.default).sendMsg(\cmd, \bnoSetRate, interval);
+    }
+
+    *setMode {
+        arg mode, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoSetMode, mode);
+    }
+
+    // value: \accel, \gyro, \mag or \quat, filter: \none, \euro, \exp or \biquad
+    *setFilter {
+        arg value, filter, cutoff = 1, parameter = 0, server;
+        value = [\accel, \gyro, \mag, \quat].indexOf(value) ? value;
+        filter = [\none, \euro, \exp, \biquad].indexOf(filter) ? filter;
+        (server ? Server.default).sendMsg(\cmd, \bnoSetFilter, value, filter, cutoff, parameter);
+    }
+
+    *setOnset {
+        arg sensitivity, minJerk, refractory, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoSetOnset, sensitivity, minJerk, refractory);
+    }
+
+    // interrupt: \any, \nomotion, \highg or \highrate; a negative threshold disables it
+    *setInterrupt {
+        arg interrupt, threshold, duration, axes = 0, server;
+        interrupt = [\any, \nomotion, \highg, \highrate].indexOf(interrupt) ? interrupt;
+        (server ? Server.default).sendMsg(\cmd, \bnoSetInterrupt, interrupt, threshold, duration, axes);
+    }
+
+    *setDrift {
+        arg on = true, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoDrift, on.binaryValue);
+    }
+
+    // 1 start collecting, 0 stop, -1 stop and clear the correction
+    *setMagFit {
+        arg mode = 1, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoMagFit, mode);
     }
 
+    *calibrate {
+        arg step = 0, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoCalibrate, step);
+    }
+
+    *loadProfile {
+        arg profile = 0, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoLoad, profile);
+    }
+
+    *saveProfile {
+        arg profile = 0, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoSave, profile);
+    }
+
+    // Gesture templates 0 to 7 are recorded from the sensor stream
+    // between recordGesture and stopGesture
+    *recordGesture {
+        arg gesture = 0, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoGestureRecord, gesture);
+    }
+
+    *stopGesture {
+        arg server;
+        (server ? Server.default).sendMsg(\cmd, \bnoGestureStop);
+    }
+
+    *clearGesture {
+        arg gesture = -1, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoGestureClear, gesture);
+    }
+
+    // mean distance per template sample at which a match is accepted
+    *setGestureThreshold {
+        arg threshold = 0.25, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoGestureThreshold, threshold);
+    }
+
+    // a path on the server's file system, nil stops recording
+    *record {
+        arg path, server;
+        (server ? Server.default).sendMsg(\cmd, \bnoRecord, path ? "");
+    }
+
+}
+
+// Rotates an ambisonic signal (ACN, SN3D or N3D, order 1 to 3) by the sensor orientation
+BNORotate : MultiOutUGen {
+    *ar {
+        arg in, invert = 1;
+        ^this.multiNewList(['audio', invert] ++ in)
+    }
+
+	init {|...theInputs|
+		inputs = theInputs;
+		^this.initOutputs(inputs.size - 1, rate);
+	}
+
+    checkInputs {
+        if([4, 9, 16].includes(inputs.size - 1).not) {
+            ^"needs 4, 9 or 16 channels (ambisonic order 1 to 3)"
+        };
+        inputs.drop(1).do { |in, i|
+            if(in.rate != 'audio') {
+                ^"channel % is not audio rate: % %".format(i, in, in.rate)
+            }
+        };
+        ^this.checkValidInputs
+    }
+}
+
+// Writes the values of channels (see BNO) to consecutive control buses from bus,
+// once per sensor frame. Any number of synths can read them with In.kr.
+BNOBus : UGen {
+    *kr {
+        arg bus, channels = 3;
+        this.multiNewList(['control', bus] ++ channels.asArray);
+        ^0.0
+    }
+
+    numOutputs { ^0 }
+    writeOutputSpecs {}
+
+    checkInputs {
+        if(inputs.size < 2) { ^"needs at least one channel" };
+        ^this.checkValidInputs
+    }
+}
+
+// Appends every sensor frame to a Buffer, as a circular history of the values
+// of channels (see BNO). Outputs the write position.
+BNOHistory : UGen {
+    *kr {
+        arg bufnum, channels = 3;
+        ^this.multiNewList(['control', bufnum] ++ channels.asArray)
+    }
+
+    // Channels of a Buffer for the values of channels
+    *numChannels {
+        arg channels = 3;
+        ^channels.asArray.sum { |channel| (0: 3, 1: 3, 2: 3, 3: 3, 5: 5)[channel] ? 0 }
+    }
 }
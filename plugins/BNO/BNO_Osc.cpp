@@ -0,0 +1,130 @@
+/*
+  OSC frame streaming
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "BNO_Osc.h"
+
+static inline void writeInt(char *p, int32_t value) {
+	uint32_t v = htonl((uint32_t)value);
+	memcpy(p, &v, 4);
+}
+
+static inline void writeFloat(char *p, float value) {
+	uint32_t v;
+	memcpy(&v, &value, 4);
+	v = htonl(v);
+	memcpy(p, &v, 4);
+}
+
+// Everything but the arguments is the same for every packet
+BNO_OscStreamer::BNO_OscStreamer() : mStop(false) {
+	static_assert(sizeof(BNO_OSC_ADDRESS) <= 12 && sizeof(BNO_OSC_TYPETAGS) <= 20,
+		"BNO_OSC_HEADER_SIZE doesn't fit the address and type tags");
+
+	memset(mPacket, 0, sizeof(mPacket));
+	memcpy(mPacket, "#bundle", 8);
+	// time tag 1 is immediately
+	writeInt(mPacket + 8, 0);
+	writeInt(mPacket + 12, 1);
+	for (int i = 0; i < BNO_OSC_MAX_BATCH; ++i) {
+		char *element = mPacket + 16 + i * (4 + BNO_OSC_MESSAGE_SIZE);
+		writeInt(element, BNO_OSC_MESSAGE_SIZE);
+		memcpy(element + 4, BNO_OSC_ADDRESS, sizeof(BNO_OSC_ADDRESS));
+		memcpy(element + 4 + 12, BNO_OSC_TYPETAGS, sizeof(BNO_OSC_TYPETAGS));
+	}
+	memset(&mAddress, 0, sizeof(mAddress));
+}
+
+bool BNO_OscStreamer::start(const char *spec) {
+	stop();
+
+	char host[128];
+	char port[16];
+	float rate = 50.f;
+	if (sscanf(spec, "%127[^:]:%15[^:]:%f", host, port, &rate) < 2 || rate <= 0.f) {
+		return false;
+	}
+	struct addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, port, &hints, &result) != 0) {
+		return false;
+	}
+	memcpy(&mAddress, result->ai_addr, sizeof(mAddress));
+	freeaddrinfo(result);
+
+	mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (mSocket < 0) {
+		return false;
+	}
+	mInterval = (unsigned int)(1e6f / rate);
+	mStop = false;
+	mThread = new std::thread(&BNO_OscStreamer::run, this);
+	return true;
+}
+
+void BNO_OscStreamer::stop() {
+	if (mThread && mThread->joinable()) {
+		mStop = true;
+		mThread->join();
+	}
+	delete mThread;
+	mThread = nullptr;
+	if (mSocket >= 0) {
+		close(mSocket);
+		mSocket = -1;
+	}
+}
+
+void BNO_OscStreamer::encode(int index, const bnoFrame_t &frame) {
+	char *p = mPacket + 16 + index * (4 + BNO_OSC_MESSAGE_SIZE) + 4 + BNO_OSC_HEADER_SIZE;
+	float values[13];
+	bnoScaleValues(frame.accel, values, 3, BNO_ACCEL);
+	bnoScaleValues(frame.gyro, values + 3, 3, BNO_GYRO);
+	bnoScaleValues(frame.mag, values + 6, 3, BNO_MAG);
+	bnoScaleValues(frame.quat, values + 9, 4, BNO_QUAT);
+
+	writeInt(p, (int32_t)mSeq++);
+	writeInt(p + 4, (int32_t)(frame.time / 1000000));
+	writeInt(p + 8, (int32_t)(frame.time % 1000000));
+	for (int i = 0; i < 13; ++i) {
+		writeFloat(p + 12 + 4 * i, values[i]);
+	}
+	writeInt(p + 12 + 4 * 13, frame.calib);
+}
+
+void BNO_OscStreamer::send(int count) {
+	size_t length = 16 + count * (4 + BNO_OSC_MESSAGE_SIZE);
+	// UDP, so a lost or refused packet is not retried
+	sendto(mSocket, mPacket, length, 0, (const struct sockaddr *)&mAddress, sizeof(mAddress));
+}
+
+// Streamer thread. Everything queued since the last interval goes out,
+// in bundles of up to BNO_OSC_MAX_BATCH frames.
+void BNO_OscStreamer::run() {
+	bnoFrame_t frame;
+	while (!mStop) {
+		int count = 0;
+		while (mFrames.pop(frame)) {
+			encode(count++, frame);
+			if (count == BNO_OSC_MAX_BATCH) {
+				send(count);
+				count = 0;
+			}
+		}
+		if (count > 0) {
+			send(count);
+		}
+		usleep(mInterval);
+	}
+}
@@ -0,0 +1,72 @@
+/*
+  OSC frame streaming
+  ----------------------------------------------------------
+  Sends frames as OSC over UDP, straight from the device service, for
+  programs on other computers. The reader thread queues every frame, and
+  the streamer thread sends what has been queued as one bundle per
+  interval, so the reader never waits for the network.
+
+  Each frame is a message
+
+      /bno/frame seq sec usec ax ay az gx gy gz mx my mz qw qx qy qz calib
+
+  with the frame counter seq, the frame time (monotonic, in seconds and
+  microseconds), accelerometer (m/s^2), gyroscope (dps), magnetometer (uT)
+  and calibrated orientation as floats and the CALIB_STAT register. The
+  message layout is fixed, so the bundle is built once and only the
+  arguments are written for each frame.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_OSC_H_
+#define BNO_OSC_H_
+
+#include <atomic>
+#include <thread>
+#include <netinet/in.h>
+
+#include "BNO_Queue.h"
+#include "imu/BNO_Frame.h"
+
+#define BNO_OSC_ADDRESS "/bno/frame"
+#define BNO_OSC_TYPETAGS ",iiifffffffffffffi"
+#define BNO_OSC_ARGS 17
+// padded address and type tags, then the arguments
+#define BNO_OSC_HEADER_SIZE 32
+#define BNO_OSC_MESSAGE_SIZE (BNO_OSC_HEADER_SIZE + 4 * BNO_OSC_ARGS)
+#define BNO_OSC_MAX_BATCH 32
+
+class BNO_OscStreamer {
+public:
+	BNO_OscStreamer();
+	~BNO_OscStreamer() { stop(); }
+
+	// spec is host:port[:rate], rate in bundles per second (default 50).
+	// Returns false if the host can't be resolved or there is no socket.
+	bool start(const char *spec);
+	void stop();
+	bool running() const { return mThread != nullptr; }
+
+	// Reader thread. Frames are dropped while the queue is full.
+	void push(const bnoFrame_t &frame) { mFrames.push(frame); }
+
+private:
+	void run();
+	void encode(int index, const bnoFrame_t &frame);
+	void send(int count);
+
+	int mSocket = -1;
+	struct sockaddr_in mAddress;
+	unsigned int mInterval = 20000; // us
+
+	BNO_Queue<bnoFrame_t, 256> mFrames;
+	uint32_t mSeq = 0;
+	// "#bundle", time tag, then size and message for each frame
+	char mPacket[16 + BNO_OSC_MAX_BATCH * (4 + BNO_OSC_MESSAGE_SIZE)];
+
+	std::atomic<bool> mStop;
+	std::thread *mThread = nullptr;
+};
+
+#endif /* BNO_OSC_H_ */
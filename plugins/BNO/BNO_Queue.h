@@ -0,0 +1,55 @@
+/*
+  Bounded single-producer single-consumer queue
+  ----------------------------------------------------------
+  Lock-free and allocation free, so push and pop are safe to call from the
+  audio thread. Size must be a power of two.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_QUEUE_H_
+#define BNO_QUEUE_H_
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T, unsigned Size>
+class BNO_Queue {
+	static_assert((Size & (Size - 1)) == 0, "BNO_Queue size must be a power of two");
+
+public:
+	BNO_Queue() : mHead(0), mTail(0) {}
+
+	// Producer side. Returns false if the queue is full.
+	bool push(const T &item) {
+		uint32_t head = mHead.load(std::memory_order_relaxed);
+		if (head - mTail.load(std::memory_order_acquire) == Size) {
+			return false;
+		}
+		mItems[head & (Size - 1)] = item;
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(T &item) {
+		uint32_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail == mHead.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = mItems[tail & (Size - 1)];
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const {
+		return mTail.load(std::memory_order_acquire) == mHead.load(std::memory_order_acquire);
+	}
+
+private:
+	T mItems[Size];
+	std::atomic<uint32_t> mHead;
+	std::atomic<uint32_t> mTail;
+};
+
+#endif /* BNO_QUEUE_H_ */
@@ -0,0 +1,813 @@
+/*
+  BNO055 device service
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "BNO_Service.h"
+
+BNO_Service::BNO_Service() : mState(), mReferenceState(), mRequestState(REQ_IDLE), mMagFitStop(false),
+	mGestureStop(false), mGestureCount(0), mGestureId(-1), mGestureConfidence(0.f), mTempoStop(false),
+	mZoneEnters(0), mZoneExits(0), mActiveZone(-1), mHistory(), mHistoryCount(0),
+	mCalStep(CAL_IDLE), mCalProgress(0.f), mCalQuality(0.f),
+	mUsers(0), mShouldStop(false), mFailed(false)
+{
+	mStorePath[0] = '\0';
+}
+
+BNO_Service::~BNO_Service()
+{
+	stop();
+	delete mReference;
+}
+
+void BNO_Service::loadProfiles(const char *path)
+{
+	snprintf(mStorePath, sizeof(mStorePath), "%s", path);
+	if (mStore.load(mStorePath)) {
+		printf("BNO: Loaded %d calibration profiles\n", mStore.size());
+		return;
+	}
+	if (access(mStorePath, F_OK) != 0) {
+		return;
+	}
+
+	// Keep a file that can't be read, the next save would overwrite it
+	char backupPath[sizeof(mStorePath) + 8];
+	snprintf(backupPath, sizeof(backupPath), "%s.bak", mStorePath);
+	// The calibration of the first versions becomes profile 0 of the default sensor
+	if (mStore.loadLegacy(mStorePath, mBno.sensorId(), "0")) {
+		if (rename(mStorePath, backupPath) == 0 && mStore.save(mStorePath)) {
+			printf("BNO: Converted the calibration in %s to profile 0, the old file is %s\n", mStorePath, backupPath);
+		} else {
+			printf("BNO: Loaded the old calibration in %s as profile 0, but couldn't convert the file\n", mStorePath);
+		}
+	} else if (rename(mStorePath, backupPath) == 0) {
+		printf("BNO: Couldn't read calibrations from %s, moved it to %s\n", mStorePath, backupPath);
+	} else {
+		printf("BNO: Couldn't read calibrations from %s\n", mStorePath);
+	}
+}
+
+void BNO_Service::acquire()
+{
+	// retry a device that failed to initialise
+	if (mFailed) {
+		stop();
+	}
+	mUsers++;
+	if (mThread == nullptr) {
+		mShouldStop = false;
+		mFailed = false;
+		mThread = new std::thread(&BNO_Service::run, this);
+	}
+}
+
+// The device keeps running without users, so the next synth doesn't pay for setup again
+void BNO_Service::release()
+{
+	mUsers--;
+}
+
+// The reader thread starts and stops the worker threads, so it is joined first
+void BNO_Service::stop()
+{
+	if (mThread && mThread->joinable()) {
+		mShouldStop = true;
+		mThread->join();
+	}
+	delete mThread;
+	mThread = nullptr;
+	stopMagFit();
+	stopGestures();
+	stopTempo();
+	mOsc.stop();
+}
+
+void BNO_Service::update(int bufCounter)
+{
+	if (bufCounter == mLastUpdate) {
+		return;
+	}
+	mLastUpdate = bufCounter;
+
+	bnoEvent_t event;
+	while (mEvents.pop(event)) {
+		switch (event.type) {
+		case EVT_RUNNING:
+			mRunning = true;
+			break;
+		case EVT_STOPPED:
+			mRunning = false;
+			break;
+		}
+	}
+	// only the latest tempo estimate matters
+	bnoTempo_t tempo;
+	while (mTempoResults.pop(tempo)) {
+		mTempo = tempo;
+	}
+}
+
+void BNO_Service::sendEvent(int type, int arg)
+{
+	bnoEvent_t event = { type, arg };
+	// Dropped if the audio thread isn't draining them, which it only does
+	// while a BNO synth runs. The reader must never wait for it.
+	mEvents.push(event);
+}
+
+// BNO_REPLAY plays back a stream recorded with BNO_RECORD instead of using the device
+bool BNO_Service::setup()
+{
+	bool ready;
+	const char *replayPath = getenv("BNO_REPLAY");
+	if (replayPath != NULL) {
+		const char *speed = getenv("BNO_REPLAY_SPEED");
+		ready = mBno.setupReplay(replayPath, speed ? atof(speed) : 1.f, getenv("BNO_REPLAY_LOOP") != NULL);
+	} else {
+		ready = mBno.setup();
+		const char *recordPath = getenv("BNO_RECORD");
+		if (ready && recordPath != NULL && !mBno.startRecording(recordPath)) {
+			printf("BNO: Couldn't record to %s\n", recordPath);
+		}
+		const char *referenceSpec = getenv("BNO_RELATIVE");
+		if (ready && referenceSpec != NULL) {
+			setupReference(referenceSpec);
+		}
+	}
+	return ready;
+}
+
+// BNO_RELATIVE is the I2C address of a second sensor, e.g. on the torso,
+// the orientation is then published relative to it. Empty or 1 is the
+// second BNO055 address.
+void BNO_Service::setupReference(const char *spec)
+{
+	long address = strtol(spec, NULL, 0);
+	if (address <= 1) {
+		address = BNO055_ADDRESS_B;
+	}
+
+	delete mReference;
+	mReference = new SC_BNO055();
+	mRelative.reset();
+	if (!mReference->setup(1, (uint8_t)address)) {
+		printf("BNO: No reference sensor at 0x%02lx, using the absolute orientation\n", address);
+		delete mReference;
+		mReference = nullptr;
+		mBno.setReference(nullptr);
+		return;
+	}
+	printf("BNO: Orientation relative to the sensor at 0x%02lx\n", address);
+	mBno.setReference(&mRelative);
+}
+
+// Read before the main sensor, so the reference frame is as close as
+// possible to the main frame it is used for
+void BNO_Service::updateReference()
+{
+	mReference->readIMU(mReferenceState);
+	imu::Quaternion q = mReference->lastQuat();
+	bnoQuatf_t quat = { (float)q.w(), (float)q.x(), (float)q.y(), (float)q.z() };
+	mRelative.addReference(mReference->lastOutput().time, quat);
+}
+
+// Filter settings as a comma separated list of value:filter:cutoff[:parameter],
+// e.g. "quat:euro:1:0.5,accel:biquad:10"
+void BNO_Service::parseFilters(const char *spec)
+{
+	static const char *types[BNO_NUM_TYPES] = { "accel", "gyro", "mag", "quat" };
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", spec);
+
+	char *save = NULL;
+	for (char *item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char typeName[16], filterName[16];
+		bnoFilterConfig_t config = { BNO_FILTER_NONE, 1.f, 0.f };
+		if (sscanf(item, "%15[^:]:%15[^:]:%f:%f", typeName, filterName, &config.cutoff, &config.param) < 2) {
+			printf("BNO: Bad filter setting %s\n", item);
+			continue;
+		}
+		int type = -1;
+		for (int i = 0; i < BNO_NUM_TYPES; ++i) {
+			if (strcmp(typeName, types[i]) == 0) {
+				type = i;
+			}
+		}
+		config.type = bnoParseFilterType(filterName);
+		if (type < 0 || config.type < 0) {
+			printf("BNO: Bad filter setting %s\n", item);
+			continue;
+		}
+		mBno.setFilter(type, config);
+	}
+}
+
+// Interrupts as a comma separated list of name[:threshold[:duration]], names
+// are any, nomotion, highg and highrate. Threshold and duration are raw values.
+void BNO_Service::parseInterrupts(const char *spec)
+{
+	static const char *names[BNO_NUM_INTERRUPTS] = { "any", "nomotion", "highg", "highrate" };
+	// defaults, for the default sensor ranges
+	static const int thresholds[BNO_NUM_INTERRUPTS] = { 20, 10, 192, 4 };
+	static const int durations[BNO_NUM_INTERRUPTS] = { 1, 4, 15, 25 };
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", spec);
+
+	char *save = NULL;
+	for (char *item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char name[16];
+		int threshold = -1, duration = -1;
+		if (sscanf(item, "%15[^:]:%d:%d", name, &threshold, &duration) < 1) {
+			continue;
+		}
+		int type = -1;
+		for (int i = 0; i < BNO_NUM_INTERRUPTS; ++i) {
+			if (strcmp(name, names[i]) == 0) {
+				type = i;
+			}
+		}
+		if (type < 0) {
+			printf("BNO: Unknown interrupt %s\n", name);
+			continue;
+		}
+		mBno.setInterrupt(type, threshold >= 0 ? threshold : thresholds[type],
+			duration >= 0 ? duration : durations[type]);
+	}
+}
+
+bool BNO_Service::saveProfile(const char *name)
+{
+	bnoCalibration_t calData;
+	mBno.getCalibration(calData);
+	if (mStore.put(mBno.sensorId(), name, calData) < 0) {
+		return false;
+	}
+	return mStore.save(mStorePath);
+}
+
+// Profiles are in memory, so loading never touches the filesystem
+bool BNO_Service::loadProfile(const char *name)
+{
+	bnoCalibration_t calData;
+	if (!mStore.get(mStore.find(mBno.sensorId(), name), calData)) {
+		return false;
+	}
+	mBno.setCalibration(calData);
+	mBno.recalcCalibration();
+	return true;
+}
+
+// Returns false if the command failed
+bool BNO_Service::runCommand(const bnoCommand_t &cmd)
+{
+	bool ok = true;
+	// profiles selected by number from the UGen are named by that number
+	char name[BNO_PROFILE_NAME_LEN];
+	snprintf(name, sizeof(name), "%d", cmd.arg);
+
+	switch (cmd.type) {
+	case CMD_CALIBRATE:
+		if (cmd.arg == 1 || (cmd.arg == 0 && mCalStep <= CAL_NEUTRAL)) {
+			bnoLog(BNO_LOG_CAL_NEUTRAL);
+			startCapture(CAL_NEUTRAL);
+		} else {
+			bnoLog(BNO_LOG_CAL_DOWN);
+			startCapture(CAL_DOWN);
+		}
+		break;
+
+	case CMD_SAVE:
+		ok = saveProfile(name);
+		bnoLog(BNO_LOG_SAVED, cmd.arg, ok);
+		break;
+
+	case CMD_LOAD:
+		ok = loadProfile(name);
+		bnoLog(BNO_LOG_LOADED, cmd.arg, ok);
+		// A load ends any calibration in progress
+		mCapture.cancel();
+		mCalStep = CAL_IDLE;
+		break;
+
+	case CMD_SET_MODE:
+		mBno.setMode(cmd.arg);
+		break;
+
+	case CMD_SET_RATE:
+		mReadInterval = cmd.arg;
+		break;
+
+	case CMD_SET_CAPTURE:
+		mCaptureWindow = cmd.arg;
+		break;
+
+	case CMD_MAG_FIT:
+		if (cmd.arg > 0) {
+			startMagFit();
+		} else {
+			stopMagFit();
+			if (cmd.arg < 0) {
+				mBno.setMagCorrection(nullptr);
+			}
+		}
+		break;
+
+	case CMD_DRIFT:
+		mBno.setDriftCompensation(cmd.arg != 0);
+		break;
+
+	case CMD_SET_FILTER: {
+		bnoFilterConfig_t config = { (int)cmd.param[0], cmd.param[1], cmd.param[2] };
+		mBno.setFilter(cmd.arg, config);
+		break;
+	}
+
+	case CMD_SET_ONSET:
+		mBno.setOnsetParameters(cmd.param[0], cmd.param[1], (uint64_t)(cmd.param[2] * 1000));
+		break;
+
+	case CMD_SET_INTERRUPT:
+		mBno.setInterrupt(cmd.arg, (int)cmd.param[0], (int)cmd.param[1], cmd.param[2] > 0.f ? (int)cmd.param[2] : 0x07);
+		break;
+
+	case CMD_GESTURE_RECORD:
+	case CMD_GESTURE_STOP:
+	case CMD_GESTURE_CLEAR:
+	case CMD_GESTURE_THRESHOLD:
+		startGestures();
+		mGestureCommands.push(cmd);
+		break;
+
+	case CMD_ZONE_CAP:
+		mZones.setCap(cmd.arg, cmd.param[0] * M_PI / 180.0, cmd.param[1] * M_PI / 180.0, cmd.param[2] * M_PI / 180.0);
+		break;
+
+	case CMD_ZONE_VERTEX:
+		mZones.addVertex(cmd.arg, cmd.param[0] * M_PI / 180.0, cmd.param[1] * M_PI / 180.0);
+		break;
+
+	case CMD_ZONE_CLEAR:
+		mZones.clear(cmd.arg);
+		break;
+
+	case CMD_TEMPO:
+		startTempo();
+		mTempoCommands.push(cmd);
+		break;
+
+	case CMD_RECORD:
+		if (cmd.arg > 0) {
+			ok = mBno.startRecording(mRequestPath);
+			if (!ok) {
+				bnoLog(BNO_LOG_RECORD_FAILED);
+			}
+		} else {
+			mBno.stopRecording();
+		}
+		break;
+	}
+
+	// test the current direction against changed zones right away
+	if (cmd.type == CMD_ZONE_CAP || cmd.type == CMD_ZONE_VERTEX || cmd.type == CMD_ZONE_CLEAR) {
+		memset(mLastZoneQuat, 0, sizeof(mLastZoneQuat));
+	}
+	return ok;
+}
+
+bool BNO_Service::request(const bnoCommand_t &cmd, const char *path, int timeoutMs)
+{
+	if (mThread == nullptr || mFailed) {
+		return false;
+	}
+	// The reader thread may still hold a request that timed out
+	int state = mRequestState.load(std::memory_order_acquire);
+	if (state == REQ_RUNNING || state == REQ_PENDING) {
+		return false;
+	}
+	mRequest = cmd;
+	snprintf(mRequestPath, sizeof(mRequestPath), "%s", path ? path : "");
+	mRequestState.store(REQ_PENDING, std::memory_order_release);
+
+	for (int waited = 0; waited < timeoutMs; ++waited) {
+		state = mRequestState.load(std::memory_order_acquire);
+		if (state == REQ_DONE || state == REQ_FAILED) {
+			mRequestState.store(REQ_IDLE, std::memory_order_relaxed);
+			return state == REQ_DONE;
+		}
+		usleep(1000);
+	}
+	// Withdraw it, or if the reader thread has just taken it, give it as
+	// long again to finish before the next request may overwrite it
+	state = REQ_PENDING;
+	if (mRequestState.compare_exchange_strong(state, REQ_IDLE)) {
+		return false;
+	}
+	for (int waited = 0; waited < timeoutMs; ++waited) {
+		state = mRequestState.load(std::memory_order_acquire);
+		if (state != REQ_RUNNING) {
+			mRequestState.store(REQ_IDLE, std::memory_order_relaxed);
+			return state == REQ_DONE;
+		}
+		usleep(1000);
+	}
+	// still running: it stays RUNNING, so request() refuses until it's done
+	return false;
+}
+
+void BNO_Service::runRequest()
+{
+	int pending = REQ_PENDING;
+	if (!mRequestState.compare_exchange_strong(pending, REQ_RUNNING, std::memory_order_acquire)) {
+		return;
+	}
+	bool ok = runCommand(mRequest);
+	mRequestState.store(ok ? REQ_DONE : REQ_FAILED, std::memory_order_release);
+}
+
+void BNO_Service::startMagFit()
+{
+	if (mMagFitThread == nullptr) {
+		bnoLog(BNO_LOG_MAG_COLLECT);
+		mMagFitStop = false;
+		mMagFitThread = new std::thread(&BNO_Service::runMagFit, this);
+	}
+}
+
+void BNO_Service::stopMagFit()
+{
+	if (mMagFitThread && mMagFitThread->joinable()) {
+		mMagFitStop = true;
+		mMagFitThread->join();
+	}
+	delete mMagFitThread;
+	mMagFitThread = nullptr;
+}
+
+// Reader thread: hand new magnetometer readings to the fit thread and
+// pick up finished fits. Unchanged readings are skipped, the chip updates
+// the magnetometer much slower than we read it.
+void BNO_Service::updateMagFit()
+{
+	bnoMagSample_t sample;
+	mBno.lastMag(sample.mag);
+	if (sample.mag[0] != mLastMag[0] || sample.mag[1] != mLastMag[1] || sample.mag[2] != mLastMag[2]) {
+		memcpy(mLastMag, sample.mag, sizeof(mLastMag));
+		mMagSamples.push(sample);
+	}
+
+	bnoMagCorrection_t correction;
+	bool found = false;
+	while (mMagResults.pop(correction)) {
+		found = true;
+	}
+	if (found) {
+		mBno.setMagCorrection(&correction);
+	}
+}
+
+// Fit thread. Refits whenever enough new points have been collected.
+void BNO_Service::runMagFit()
+{
+	BNO_MagFit *fit = new BNO_MagFit();
+	bnoMagSample_t sample;
+
+	while (!mMagFitStop) {
+		while (mMagSamples.pop(sample)) {
+			fit->add(sample.mag);
+		}
+		if (fit->size() >= BNO_MAGFIT_MIN_POINTS && fit->newPoints() >= BNO_MAGFIT_MIN_POINTS / 2) {
+			bnoMagCorrection_t correction;
+			if (fit->fit(correction)) {
+				const float *offset = correction.offset;
+				float length = sqrtf(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+				bnoLog(BNO_LOG_MAG_FIT, (int32_t)lrintf(length * 10.f), fit->size());
+				mMagResults.push(correction);
+			}
+		}
+		usleep(50000);
+	}
+	delete fit;
+}
+
+void BNO_Service::startGestures()
+{
+	if (mGestureThread == nullptr) {
+		mGestureStop = false;
+		mGestureThread = new std::thread(&BNO_Service::runGestures, this);
+	}
+}
+
+void BNO_Service::stopGestures()
+{
+	if (mGestureThread && mGestureThread->joinable()) {
+		mGestureStop = true;
+		mGestureThread->join();
+	}
+	delete mGestureThread;
+	mGestureThread = nullptr;
+}
+
+// Gestures are matched on a fixed rate, in us
+#define BNO_GESTURE_INTERVAL 20000
+
+// Reader thread: hand feature samples to the gesture thread. The features
+// are the direction of gravity (orientation without heading) and the
+// linear acceleration in g.
+void BNO_Service::updateGestures()
+{
+	uint64_t now = bnoTimeUs();
+	if (now - mLastGestureSample < BNO_GESTURE_INTERVAL) {
+		return;
+	}
+	mLastGestureSample = now;
+
+	imu::Vector<3> gravity = mBno.lastGravity();
+	gravity.normalize();
+	imu::Vector<3> accel = mBno.lastLinearAccel();
+	bnoGestureSample_t sample;
+	for (int i = 0; i < 3; ++i) {
+		sample.values[i] = gravity[i];
+		sample.values[3 + i] = accel[i] / 9.81;
+	}
+	mGestureSamples.push(sample);
+}
+
+// Gesture thread. Commands are handled in order with the samples, so a
+// recording starts at the sample after the command.
+void BNO_Service::runGestures()
+{
+	BNO_Gesture *gestures = new BNO_Gesture();
+	bnoGestureSample_t sample;
+	bnoCommand_t cmd;
+
+	while (!mGestureStop) {
+		while (mGestureCommands.pop(cmd)) {
+			switch (cmd.type) {
+			case CMD_GESTURE_RECORD:
+				bnoLog(BNO_LOG_GESTURE_RECORD, cmd.arg);
+				gestures->startRecording(cmd.arg);
+				break;
+			case CMD_GESTURE_STOP:
+				if (!gestures->stopRecording()) {
+					bnoLog(BNO_LOG_GESTURE_SHORT);
+				}
+				break;
+			case CMD_GESTURE_CLEAR:
+				gestures->clear(cmd.arg);
+				break;
+			case CMD_GESTURE_THRESHOLD:
+				gestures->setThreshold(cmd.param[0]);
+				break;
+			}
+		}
+		while (mGestureSamples.pop(sample)) {
+			if (gestures->add(sample.values)) {
+				mGestureId.store(gestures->matchId(), std::memory_order_relaxed);
+				mGestureConfidence.store(gestures->matchConfidence(), std::memory_order_relaxed);
+				mGestureCount.fetch_add(1, std::memory_order_release);
+			}
+		}
+		usleep(BNO_GESTURE_INTERVAL / 2);
+	}
+	delete gestures;
+}
+
+void BNO_Service::startTempo()
+{
+	if (mTempoThread == nullptr) {
+		mTempoStop = false;
+		mTempoThread = new std::thread(&BNO_Service::runTempo, this);
+	}
+}
+
+void BNO_Service::stopTempo()
+{
+	if (mTempoThread && mTempoThread->joinable()) {
+		mTempoStop = true;
+		mTempoThread->join();
+	}
+	delete mTempoThread;
+	mTempoThread = nullptr;
+}
+
+#define BNO_TEMPO_INTERVAL (1000000 / BNO_TEMPO_RATE)
+
+// Reader thread: hand the linear acceleration magnitude to the tempo
+// thread at a fixed rate
+void BNO_Service::updateTempo()
+{
+	uint64_t now = bnoTimeUs();
+	if (now - mLastTempoSample < BNO_TEMPO_INTERVAL) {
+		return;
+	}
+	mLastTempoSample = now;
+
+	bnoTempoSample_t sample = { mBno.lastOutput().features[BNO_LINEAR_ACCEL], now };
+	mTempoSamples.push(sample);
+}
+
+// Tempo thread. An estimate every BNO_TEMPO_HOP samples, with the time of
+// the last sample, so units can carry the phase on.
+void BNO_Service::runTempo()
+{
+	BNO_Tempo *tempo = new BNO_Tempo();
+	bnoTempoSample_t sample;
+	bnoCommand_t cmd;
+
+	while (!mTempoStop) {
+		while (mTempoCommands.pop(cmd)) {
+			if (cmd.param[0] > 0.f && cmd.param[1] > cmd.param[0]) {
+				tempo->setRange(cmd.param[0], cmd.param[1]);
+			}
+		}
+		while (mTempoSamples.pop(sample)) {
+			if (tempo->add(sample.value)) {
+				bnoTempo_t result = { tempo->bpm(), tempo->confidence(), tempo->phase(), sample.time };
+				mTempoResults.push(result);
+			}
+		}
+		usleep(BNO_TEMPO_INTERVAL * 4);
+	}
+	delete tempo;
+}
+
+// Reader thread: track the forward direction (x) of the calibrated
+// orientation through the zones, when it changes
+void BNO_Service::updateZones()
+{
+	const int16_t *q = mBno.lastOutput().quat;
+	if (memcmp(q, mLastZoneQuat, sizeof(mLastZoneQuat)) == 0) {
+		return;
+	}
+	memcpy(mLastZoneQuat, q, sizeof(mLastZoneQuat));
+
+	const double scale = 1.0 / BNO_QUAT_ONE;
+	imu::Quaternion quat(scale * q[0], scale * q[1], scale * q[2], scale * q[3]);
+	quat.normalize();
+	if (mZones.update(quat.rotateVector(imu::Vector<3>(1, 0, 0)))) {
+		mActiveZone.store(mZones.active(), std::memory_order_relaxed);
+		mZoneEnters.fetch_add(__builtin_popcount(mZones.entered()), std::memory_order_relaxed);
+		mZoneExits.fetch_add(__builtin_popcount(mZones.exited()), std::memory_order_relaxed);
+	}
+}
+
+// Reader thread: add each new frame to the history, and to the shared
+// memory ring if there is one
+void BNO_Service::updateHistory()
+{
+	const bnoFrame_t &frame = mBno.lastOutput();
+	if (frame.time == mLastHistoryTime) {
+		return;
+	}
+	mLastHistoryTime = frame.time;
+	uint32_t count = mHistoryCount.load(std::memory_order_relaxed);
+	bnoPublish(mHistory[count % BNO_HISTORY_SIZE], frame);
+	mHistoryCount.store(count + 1, std::memory_order_release);
+	mShm.write(frame);
+	if (mOsc.running()) {
+		mOsc.push(frame);
+	}
+}
+
+// The slot is reused for frame index + BNO_HISTORY_SIZE, which has started
+// once the count has reached it
+bool BNO_Service::historyFrame(uint32_t index, bnoFrame_t &frame) const
+{
+	if (!bnoRead(mHistory[index % BNO_HISTORY_SIZE], frame)) {
+		return false;
+	}
+	return historyCount() - index < BNO_HISTORY_SIZE;
+}
+
+// Captures run over several frames while streaming continues
+void BNO_Service::startCapture(int step)
+{
+	mCapture.start((uint64_t)mCaptureWindow * 1000);
+	mCalStep = step;
+	mCalProgress = 0.f;
+	mCalAttempts = 1;
+}
+
+void BNO_Service::updateCapture()
+{
+	bool done = mCapture.add(bnoTimeUs(), mBno.lastGravity(), mBno.lastQuat());
+	mCalProgress = mCapture.progress();
+	if (!done) {
+		return;
+	}
+
+	mCalQuality = mCapture.quality();
+	if (!mCapture.accepted()) {
+		// the previous calibration stays in use
+		if (mCalAttempts >= BNO_CAL_MAX_ATTEMPTS) {
+			bnoLog(BNO_LOG_CAL_FAILED, mCalAttempts);
+			mCalStep = CAL_FAILED;
+			mCalProgress = 0.f;
+			return;
+		}
+		bnoLog(BNO_LOG_CAL_MOTION);
+		mCapture.start((uint64_t)mCaptureWindow * 1000);
+		mCalProgress = 0.f;
+		mCalAttempts++;
+		return;
+	}
+
+	if (mCalStep == CAL_NEUTRAL) {
+		mBno.setNeutralGravity(mCapture.gravity(), mCapture.quat());
+		mCalStep = CAL_WAIT_DOWN;
+	} else {
+		mBno.setDownGravity(mCapture.gravity());
+		mBno.recalcCalibration();
+		bnoLog(BNO_LOG_CAL_DONE);
+		mCalStep = CAL_IDLE;
+	}
+}
+
+// Reader thread. Device setup happens here, never on the audio thread.
+void BNO_Service::run()
+{
+	if (!setup()) {
+		printf("Error initialising BNO055\n");
+		mFailed = true;
+		sendEvent(EVT_STOPPED);
+		return;
+	}
+
+	bnoCommand_t load = { CMD_LOAD, 0, { 0.f, 0.f, 0.f } };
+	runCommand(load);
+	sendEvent(EVT_RUNNING);
+
+	if (getenv("BNO_MAG_FIT") != NULL) {
+		startMagFit();
+	}
+	if (getenv("BNO_DRIFT") != NULL) {
+		mBno.setDriftCompensation(true);
+	}
+	if (getenv("BNO_FILTER") != NULL) {
+		parseFilters(getenv("BNO_FILTER"));
+	}
+	if (getenv("BNO_INTERRUPTS") != NULL) {
+		parseInterrupts(getenv("BNO_INTERRUPTS"));
+	}
+	// BNO_SHM publishes frames to other processes, under its value if that
+	// is a name starting with /
+	const char *shmName = getenv("BNO_SHM");
+	if (shmName != NULL) {
+		shmName = shmName[0] == '/' ? shmName : BNO_SHM_NAME;
+		if (mShm.open(shmName)) {
+			printf("BNO: Publishing frames to shared memory %s\n", shmName);
+		} else {
+			printf("BNO: Couldn't create shared memory %s\n", shmName);
+		}
+	}
+	// BNO_OSC=host:port[:rate] streams frames over UDP, rate bundles per second
+	const char *oscSpec = getenv("BNO_OSC");
+	if (oscSpec != NULL) {
+		if (mOsc.start(oscSpec)) {
+			printf("BNO: Streaming frames to %s\n", oscSpec);
+		} else {
+			printf("BNO: Couldn't stream frames to %s\n", oscSpec);
+		}
+	}
+
+	while (!mShouldStop && !Bela_stopRequested()) {
+		bnoCommand_t cmd;
+		while (mCommands.pop(cmd)) {
+			runCommand(cmd);
+		}
+		runRequest();
+		// other processes may be reading frames when no synth is
+		if (mUsers == 0 && !mShm.isOpen() && !mOsc.running()) {
+			usleep(10000);
+			continue;
+		}
+		if (mReference != nullptr) {
+			updateReference();
+		}
+		mBno.readIMU(mState);
+		updateHistory();
+		if (mCapture.active()) {
+			updateCapture();
+		}
+		if (mMagFitThread != nullptr) {
+			updateMagFit();
+		}
+		if (mGestureThread != nullptr) {
+			updateGestures();
+		}
+		if (mTempoThread != nullptr) {
+			updateTempo();
+		}
+		if (!mZones.empty() || mZones.active() >= 0) {
+			updateZones();
+		}
+		usleep(mReadInterval);
+	}
+}
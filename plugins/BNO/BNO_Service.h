@@ -0,0 +1,268 @@
+/*
+  BNO055 device service
+  ----------------------------------------------------------
+  Owns the sensor and its reader thread, independent of any unit. Units
+  acquire the service from the non-realtime thread and then only talk to it
+  through lock-free queues and the published frame, so nothing on the audio
+  thread blocks or allocates.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_SERVICE_H_
+#define BNO_SERVICE_H_
+
+#include <atomic>
+#include <thread>
+
+#include "BNO_Queue.h"
+#include "BNO_Osc.h"
+#include "imu/SC_BNO055.h"
+#include "imu/BNO_Calibration.h"
+#include "imu/BNO_Capture.h"
+#include "imu/BNO_MagFit.h"
+#include "imu/BNO_Gesture.h"
+#include "imu/BNO_Zones.h"
+#include "imu/BNO_Relative.h"
+#include "imu/BNO_Tempo.h"
+#include "imu/BNO_ShmWriter.h"
+#include "imu/BNO_Log.h"
+
+// Captures of a calibration step rejected for motion before giving up
+#define BNO_CAL_MAX_ATTEMPTS 5
+
+// Calibration progress, published for the calibration outputs
+enum bnoCalibrationStep {
+	CAL_FAILED = -1, // a step was rejected BNO_CAL_MAX_ATTEMPTS times
+	CAL_IDLE = 0,
+	CAL_NEUTRAL,    // capturing the neutral position
+	CAL_WAIT_DOWN,  // neutral done, waiting for the second trigger
+	CAL_DOWN        // capturing the tilted down position
+};
+
+// Commands from the audio thread to the reader thread
+enum bnoCommandType {
+	CMD_CALIBRATE,  // arg: calibration step 1 or 2, 0 for the next step
+	CMD_SAVE,       // arg: profile number
+	CMD_LOAD,       // arg: profile number
+	CMD_SET_MODE,   // arg: I2C_BNO055::i2c_bno055_opmode_t
+	CMD_SET_RATE,   // arg: read interval in microseconds
+	CMD_SET_CAPTURE,// arg: calibration capture window in milliseconds
+	CMD_MAG_FIT,    // arg: 1 start, 0 stop collecting, -1 stop and clear the correction
+	CMD_DRIFT,      // arg: 1 enable yaw drift compensation, 0 disable
+	CMD_SET_FILTER, // arg: bnoValueType, param: bnoFilterType, cutoff, filter parameter
+	CMD_SET_ONSET,  // param: sensitivity, minimum jerk (m/s^3), refractory period (ms)
+	CMD_SET_INTERRUPT,// arg: bnoInterrupt, param: raw threshold (negative disables), duration, axes
+	CMD_GESTURE_RECORD,   // arg: gesture template to record
+	CMD_GESTURE_STOP,     // stop recording and keep the template
+	CMD_GESTURE_CLEAR,    // arg: gesture template, -1 for all
+	CMD_GESTURE_THRESHOLD,// param: match threshold, see BNO_Gesture
+	CMD_ZONE_CAP,     // arg: zone, param: azimuth, elevation, radius in degrees
+	CMD_ZONE_VERTEX,  // arg: zone, param: azimuth, elevation in degrees. Adds a polygon vertex.
+	CMD_ZONE_CLEAR,   // arg: zone, -1 for all
+	CMD_TEMPO,        // start tempo estimation, param: tempo range in bpm, 0 keeps it
+	CMD_RECORD        // arg: 1 start recording to the request path, 0 stop. Only from request().
+};
+
+typedef struct {
+	int type;
+	int arg;
+	float param[3]; // for commands that need more than arg
+} bnoCommand_t;
+
+// State changes from the reader thread back to the audio thread. Command
+// results are logged, and calibration progress is read directly.
+enum bnoEventType {
+	EVT_RUNNING,        // streaming, outputs are valid
+	EVT_STOPPED         // device could not be initialised
+};
+
+typedef struct {
+	int type;
+	int arg;
+} bnoEvent_t;
+
+// Tempo estimate, see BNO_Tempo
+typedef struct {
+	float bpm;
+	float confidence;
+	float phase;   // at time
+	uint64_t time; // microseconds, monotonic
+} bnoTempo_t;
+
+// Published frames kept for consumers that need every frame, not just the latest
+#define BNO_HISTORY_SIZE 128
+
+class BNO_Service {
+public:
+	BNO_Service();
+	~BNO_Service();
+
+	// Read all calibration profiles into memory, at plugin load
+	void loadProfiles(const char *path);
+
+	// Non-realtime thread. The first acquire starts the device.
+	void acquire();
+	void release();
+
+	// Non-realtime thread. Run cmd on the reader thread and wait for it, with
+	// path for commands that need one. False if the command failed, the
+	// device isn't running or it wasn't done within timeoutMs. A request
+	// still running after twice that is left to finish on its own, and
+	// requests fail until it has. The caller holds up the server's other
+	// asynchronous commands meanwhile, so the timeout is short; commands
+	// take one pass of the reader loop.
+	bool request(const bnoCommand_t &cmd, const char *path = nullptr, int timeoutMs = 100);
+	// Non-realtime thread. The reader thread runs and the device didn't fail.
+	bool started() const { return mThread != nullptr && !mFailed; }
+
+	// Realtime thread
+	bool push(const bnoCommand_t &cmd) { return mCommands.push(cmd); }
+	// Drain completion events, once per control block
+	void update(int bufCounter);
+	bool running() const { return mRunning; }
+	const bnoState_t &state() const { return mState; }
+	int calibrationStep() const { return mCalStep.load(std::memory_order_relaxed); }
+	float calibrationProgress() const { return mCalProgress.load(std::memory_order_relaxed); }
+	float calibrationQuality() const { return mCalQuality.load(std::memory_order_relaxed); }
+	// Incremented on each gesture match
+	uint32_t gestureCount() const { return mGestureCount.load(std::memory_order_acquire); }
+	int gestureId() const { return mGestureId.load(std::memory_order_relaxed); }
+	float gestureConfidence() const { return mGestureConfidence.load(std::memory_order_relaxed); }
+	// Incremented on each zone entered or left
+	uint32_t zoneEnters() const { return mZoneEnters.load(std::memory_order_relaxed); }
+	uint32_t zoneExits() const { return mZoneExits.load(std::memory_order_relaxed); }
+	int activeZone() const { return mActiveZone.load(std::memory_order_relaxed); }
+	// Last tempo estimate, updated in update()
+	const bnoTempo_t &tempo() const { return mTempo; }
+	// Total number of frames added to the history
+	uint32_t historyCount() const { return mHistoryCount.load(std::memory_order_acquire); }
+	// Frame number index of the history, false if it has been overwritten
+	bool historyFrame(uint32_t index, bnoFrame_t &frame) const;
+
+private:
+	void run();
+	bool setup();
+	bool runCommand(const bnoCommand_t &cmd);
+	void runRequest();
+	void startCapture(int step);
+	void updateCapture();
+	void updateMagFit();
+	void runMagFit();
+	void startMagFit();
+	void stopMagFit();
+	void updateGestures();
+	void runGestures();
+	void startGestures();
+	void stopGestures();
+	void updateZones();
+	void updateTempo();
+	void runTempo();
+	void startTempo();
+	void stopTempo();
+	void updateHistory();
+	void setupReference(const char *spec);
+	void updateReference();
+	bool saveProfile(const char *name);
+	bool loadProfile(const char *name);
+	void sendEvent(int type, int arg = 0);
+	void stop();
+	void parseFilters(const char *spec);
+	void parseInterrupts(const char *spec);
+
+	SC_BNO055 mBno;
+	bnoState_t mState;
+
+	// second sensor the orientation is made relative to, see BNO_Relative
+	SC_BNO055 *mReference = nullptr;
+	bnoState_t mReferenceState;
+	BNO_Relative mRelative;
+
+	BNO_CalibrationStore mStore;
+	char mStorePath[1024];
+
+	// Producer is the audio thread. scsynth calls units from a single thread;
+	// supernova, which runs parallel groups on several, is not supported.
+	BNO_Queue<bnoCommand_t, 64> mCommands;
+	BNO_Queue<bnoEvent_t, 64> mEvents;
+
+	// one request at a time from the non-realtime thread, see request()
+	enum { REQ_IDLE, REQ_PENDING, REQ_RUNNING, REQ_DONE, REQ_FAILED };
+	std::atomic<int> mRequestState;
+	bnoCommand_t mRequest;
+	char mRequestPath[256];
+
+	// realtime thread state
+	bool mRunning = false;
+	int mLastUpdate = -1;
+	bnoTempo_t mTempo = { 0.f, 0.f, 0.f, 0 };
+
+	// reader thread state
+	BNO_Capture mCapture;
+	unsigned int mCaptureWindow = 1000; // ms
+	int mCalAttempts = 0; // captures of the current step
+	unsigned int mReadInterval = 50; // read interval in us
+
+	// magnetometer fit, samples go to the fit thread and results come back
+	typedef struct {
+		float mag[3];
+	} bnoMagSample_t;
+	BNO_Queue<bnoMagSample_t, 256> mMagSamples;
+	BNO_Queue<bnoMagCorrection_t, 4> mMagResults;
+	float mLastMag[3] = { 0.f, 0.f, 0.f };
+	std::atomic<bool> mMagFitStop;
+	std::thread *mMagFitThread = nullptr;
+
+	// gesture recognition, samples and commands go to the gesture thread
+	typedef struct {
+		float values[BNO_GESTURE_DIM];
+	} bnoGestureSample_t;
+	BNO_Queue<bnoGestureSample_t, 64> mGestureSamples;
+	BNO_Queue<bnoCommand_t, 16> mGestureCommands;
+	uint64_t mLastGestureSample = 0;
+	std::atomic<bool> mGestureStop;
+	std::thread *mGestureThread = nullptr;
+	std::atomic<uint32_t> mGestureCount;
+	std::atomic<int> mGestureId;
+	std::atomic<float> mGestureConfidence;
+
+	// tempo estimation, samples and commands go to the tempo thread,
+	// estimates to the realtime thread
+	typedef struct {
+		float value;
+		uint64_t time;
+	} bnoTempoSample_t;
+	BNO_Queue<bnoTempoSample_t, 64> mTempoSamples;
+	BNO_Queue<bnoCommand_t, 16> mTempoCommands;
+	BNO_Queue<bnoTempo_t, 16> mTempoResults;
+	uint64_t mLastTempoSample = 0;
+	std::atomic<bool> mTempoStop;
+	std::thread *mTempoThread = nullptr;
+
+	// orientation zones, evaluated on the reader thread
+	BNO_Zones mZones;
+	int16_t mLastZoneQuat[4] = { 0, 0, 0, 0 };
+	std::atomic<uint32_t> mZoneEnters;
+	std::atomic<uint32_t> mZoneExits;
+	std::atomic<int> mActiveZone;
+
+	// ring of the last published frames, one seqlock per slot
+	bnoState_t mHistory[BNO_HISTORY_SIZE];
+	std::atomic<uint32_t> mHistoryCount;
+	uint64_t mLastHistoryTime = 0;
+	// the same frames for other processes, see BNO_Shm.h
+	BNO_ShmWriter mShm;
+	// and for other computers, over OSC
+	BNO_OscStreamer mOsc;
+
+	std::atomic<int> mCalStep;
+	std::atomic<float> mCalProgress;
+	std::atomic<float> mCalQuality;
+
+	std::atomic<int> mUsers;
+	std::atomic<bool> mShouldStop;
+	std::atomic<bool> mFailed;
+	std::thread *mThread = nullptr;
+};
+
+#endif /* BNO_SERVICE_H_ */
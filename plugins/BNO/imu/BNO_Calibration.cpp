@@ -0,0 +1,153 @@
+/*
+  Calibration store
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "BNO_Calibration.h"
+
+// Bitwise CRC-32 (IEEE), only used when loading and saving
+uint32_t bnoCrc32(const void *data, size_t length, uint32_t crc) {
+	const uint8_t *p = (const uint8_t *)data;
+	crc = ~crc;
+	for (size_t i = 0; i < length; ++i) {
+		crc ^= p[i];
+		for (int k = 0; k < 8; ++k) {
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+bool BNO_CalibrationStore::load(const char *path) {
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	// Older versions are a prefix of the current profile, the rest is zeroed
+	bnoCalHeader_t header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+		&& memcmp(header.magic, BNO_CAL_MAGIC, 4) == 0
+		&& ((header.version == BNO_CAL_VERSION && header.profileSize == sizeof(bnoProfile_t))
+			|| (header.version == 1 && header.profileSize == BNO_PROFILE_V1_SIZE))
+		&& header.numProfiles <= BNO_MAX_PROFILES;
+
+	uint32_t crc = 0;
+	for (uint32_t i = 0; ok && i < header.numProfiles; ++i) {
+		memset(&mProfiles[i], 0, sizeof(bnoProfile_t));
+		ok = fread(&mProfiles[i], header.profileSize, 1, fp) == 1;
+		crc = bnoCrc32(&mProfiles[i], header.profileSize, crc);
+	}
+	ok = ok && crc == header.crc;
+	fclose(fp);
+
+	mNumProfiles = ok ? header.numProfiles : 0;
+	return ok;
+}
+
+bool BNO_CalibrationStore::loadLegacy(const char *path, uint32_t sensorId, const char *name) {
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) {
+		return false;
+	}
+	// exactly one raw calibration, nothing more
+	double values[10];
+	bool ok = fread(values, sizeof(values), 1, fp) == 1 && fgetc(fp) == EOF;
+	fclose(fp);
+	if (!ok) {
+		return false;
+	}
+
+	bnoCalibration_t calData = {};
+	calData.idleConj = imu::Quaternion(values[0], values[1], values[2], values[3]);
+	calData.gravIdle = imu::Vector<3>(values[4], values[5], values[6]);
+	calData.gravCal = imu::Vector<3>(values[7], values[8], values[9]);
+	mNumProfiles = 0;
+	return put(sensorId, name, calData) >= 0;
+}
+
+// Written to a temporary file first, so a failed save keeps the old profiles
+bool BNO_CalibrationStore::save(const char *path) const {
+	char tmpPath[1024];
+	if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath)) {
+		return false;
+	}
+	FILE *fp = fopen(tmpPath, "wb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	bnoCalHeader_t header;
+	memcpy(header.magic, BNO_CAL_MAGIC, 4);
+	header.version = BNO_CAL_VERSION;
+	header.profileSize = sizeof(bnoProfile_t);
+	header.numProfiles = mNumProfiles;
+	header.crc = bnoCrc32(mProfiles, mNumProfiles * sizeof(bnoProfile_t));
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fwrite(mProfiles, sizeof(bnoProfile_t), mNumProfiles, fp) == (size_t)mNumProfiles;
+	ok = (fclose(fp) == 0) && ok;
+
+	return ok && rename(tmpPath, path) == 0;
+}
+
+int BNO_CalibrationStore::find(uint32_t sensorId, const char *name) const {
+	for (int i = 0; i < mNumProfiles; ++i) {
+		if (mProfiles[i].sensorId == sensorId && strncmp(mProfiles[i].name, name, BNO_PROFILE_NAME_LEN) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool BNO_CalibrationStore::get(int index, bnoCalibration_t &calData) const {
+	if (index < 0 || index >= mNumProfiles) {
+		return false;
+	}
+	const bnoProfile_t &p = mProfiles[index];
+	calData.idleConj = imu::Quaternion(p.idleConj[0], p.idleConj[1], p.idleConj[2], p.idleConj[3]);
+	calData.gravIdle = imu::Vector<3>(p.gravIdle[0], p.gravIdle[1], p.gravIdle[2]);
+	calData.gravCal = imu::Vector<3>(p.gravCal[0], p.gravCal[1], p.gravCal[2]);
+	memcpy(calData.sensorOffsets, p.sensorOffsets, NUM_BNO055_OFFSET_REGISTERS);
+	calData.hasSensorOffsets = p.hasSensorOffsets != 0;
+	memcpy(calData.magCorrection.offset, p.magOffset, sizeof(p.magOffset));
+	memcpy(calData.magCorrection.matrix, p.magMatrix, sizeof(p.magMatrix));
+	calData.hasMagCorrection = p.hasMagCorrection != 0;
+	return true;
+}
+
+int BNO_CalibrationStore::put(uint32_t sensorId, const char *name, const bnoCalibration_t &calData) {
+	int index = find(sensorId, name);
+	if (index < 0) {
+		if (mNumProfiles == BNO_MAX_PROFILES) {
+			return -1;
+		}
+		index = mNumProfiles++;
+	}
+
+	bnoProfile_t &p = mProfiles[index];
+	memset(&p, 0, sizeof(p));
+	strncpy(p.name, name, BNO_PROFILE_NAME_LEN - 1);
+	p.sensorId = sensorId;
+	p.idleConj[0] = calData.idleConj.w();
+	p.idleConj[1] = calData.idleConj.x();
+	p.idleConj[2] = calData.idleConj.y();
+	p.idleConj[3] = calData.idleConj.z();
+	for (int i = 0; i < 3; ++i) {
+		p.gravIdle[i] = calData.gravIdle[i];
+		p.gravCal[i] = calData.gravCal[i];
+	}
+	memcpy(p.sensorOffsets, calData.sensorOffsets, NUM_BNO055_OFFSET_REGISTERS);
+	p.hasSensorOffsets = calData.hasSensorOffsets;
+	memcpy(p.magOffset, calData.magCorrection.offset, sizeof(p.magOffset));
+	memcpy(p.magMatrix, calData.magCorrection.matrix, sizeof(p.magMatrix));
+	p.hasMagCorrection = calData.hasMagCorrection;
+	return index;
+}
+
+const char *BNO_CalibrationStore::name(int index) const {
+	return (index >= 0 && index < mNumProfiles) ? mProfiles[index].name : "";
+}
@@ -0,0 +1,81 @@
+/*
+  Calibration store
+  ----------------------------------------------------------
+  Named calibration profiles for one or more sensors, kept in one file with
+  a versioned, checksummed header. The whole file is read into memory once,
+  so switching profiles never touches the filesystem.
+
+  Profiles are stored field by field in a fixed layout, independent of the
+  in-memory bnoCalibration_t.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_CALIBRATION_H_
+#define BNO_CALIBRATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SC_BNO055.h"
+
+#define BNO_CAL_MAGIC "BNOC"
+#define BNO_CAL_VERSION 2
+#define BNO_PROFILE_NAME_LEN 32
+#define BNO_MAX_PROFILES 64
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t profileSize; // sizeof(bnoProfile_t)
+	uint32_t numProfiles;
+	uint32_t crc;         // CRC-32 of all profile records
+} bnoCalHeader_t;
+
+typedef struct {
+	char name[BNO_PROFILE_NAME_LEN];
+	uint32_t sensorId;
+	float idleConj[4];
+	float gravIdle[3];
+	float gravCal[3];
+	uint8_t sensorOffsets[NUM_BNO055_OFFSET_REGISTERS];
+	uint8_t hasSensorOffsets;
+	uint8_t hasMagCorrection; // version 2
+	float magOffset[3];
+	float magMatrix[9];
+} bnoProfile_t;
+
+// Size of a version 1 profile, which is the start of the current one
+#define BNO_PROFILE_V1_SIZE offsetof(bnoProfile_t, magOffset)
+
+// Calibration file of the first plugin versions: the raw in-memory
+// calibration of one sensor, idleConj (w x y z), gravIdle and gravCal as
+// doubles, with no header
+#define BNO_CAL_LEGACY_SIZE (10 * sizeof(double))
+
+// CRC-32, pass the previous result as crc to continue a checksum
+uint32_t bnoCrc32(const void *data, size_t length, uint32_t crc = 0);
+
+class BNO_CalibrationStore {
+public:
+	BNO_CalibrationStore() {};
+
+	bool load(const char *path);
+	// Read a legacy file as profile name of sensorId, replacing all profiles
+	bool loadLegacy(const char *path, uint32_t sensorId, const char *name);
+	bool save(const char *path) const;
+
+	// Index of a profile, or -1
+	int find(uint32_t sensorId, const char *name) const;
+
+	bool get(int index, bnoCalibration_t &calData) const;
+	// Add or replace a profile, returns its index or -1 if the store is full
+	int put(uint32_t sensorId, const char *name, const bnoCalibration_t &calData);
+	const char *name(int index) const;
+	int size() const { return mNumProfiles; }
+
+private:
+	bnoProfile_t mProfiles[BNO_MAX_PROFILES];
+	int mNumProfiles = 0;
+};
+
+#endif /* BNO_CALIBRATION_H_ */
@@ -0,0 +1,108 @@
+/*
+  Averaged calibration capture
+
+  Johannes Burström 2021
+*/
+
+#include <string.h>
+#include "BNO_Capture.h"
+
+// Fewer samples than this and the window is rejected
+#define BNO_CAPTURE_MIN_SAMPLES 8
+
+void BNO_Capture::start(uint64_t duration) {
+	mActive = true;
+	mStart = 0;
+	mDuration = duration;
+	mCount = 0;
+	memset(mSum, 0, sizeof(mSum));
+	memset(mSumSq, 0, sizeof(mSumSq));
+	memset(mQQ, 0, sizeof(mQQ));
+	mProgress = 0.f;
+	mQuality = 0.f;
+	mAccepted = false;
+}
+
+bool BNO_Capture::add(uint64_t time, const imu::Vector<3> &gravity, const imu::Quaternion &quat) {
+	if (!mActive) {
+		return false;
+	}
+	if (mCount == 0) {
+		mStart = time;
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		mSum[i] += gravity[i];
+		mSumSq[i] += gravity[i] * gravity[i];
+	}
+	const double q[4] = { quat.w(), quat.x(), quat.y(), quat.z() };
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			mQQ[i][j] += q[i] * q[j];
+		}
+	}
+	mCount++;
+
+	uint64_t elapsed = time - mStart;
+	mProgress = mDuration > 0 ? (float)elapsed / mDuration : 1.f;
+	if (mProgress < 1.f) {
+		return false;
+	}
+	mProgress = 1.f;
+	finish();
+	return true;
+}
+
+void BNO_Capture::finish() {
+	mActive = false;
+	if (mCount < BNO_CAPTURE_MIN_SAMPLES) {
+		mAccepted = false;
+		mQuality = 0.f;
+		return;
+	}
+
+	double variance = 0.0;
+	for (int i = 0; i < 3; ++i) {
+		double mean = mSum[i] / mCount;
+		mGravity[i] = mean;
+		variance += mSumSq[i] / mCount - mean * mean;
+	}
+	double deviation = sqrt(variance > 0.0 ? variance : 0.0);
+
+	// Power iteration for the dominant eigenvector, starting from the first axis
+	// with the largest diagonal so it can't be orthogonal to the answer
+	double v[4] = { 0.0, 0.0, 0.0, 0.0 };
+	int start = 0;
+	for (int i = 1; i < 4; ++i) {
+		if (mQQ[i][i] > mQQ[start][start]) {
+			start = i;
+		}
+	}
+	v[start] = 1.0;
+	double lambda = 0.0;
+	for (int iter = 0; iter < 32; ++iter) {
+		double w[4];
+		double norm = 0.0;
+		for (int i = 0; i < 4; ++i) {
+			w[i] = mQQ[i][0] * v[0] + mQQ[i][1] * v[1] + mQQ[i][2] * v[2] + mQQ[i][3] * v[3];
+			norm += w[i] * w[i];
+		}
+		norm = sqrt(norm);
+		if (norm == 0.0) {
+			break;
+		}
+		for (int i = 0; i < 4; ++i) {
+			v[i] = w[i] / norm;
+		}
+		lambda = norm;
+	}
+	// q and -q are the same rotation, keep w positive
+	double sign = v[0] < 0.0 ? -1.0 : 1.0;
+	mQuat = imu::Quaternion(sign * v[0], sign * v[1], sign * v[2], sign * v[3]);
+
+	// lambda / count is 1 when all orientations agree
+	double spread = 1.0 - lambda / mCount;
+
+	mQuality = (float)(exp(-deviation / mThreshold) * (1.0 - fmin(1.0, spread * 100.0)));
+	mAccepted = deviation < mThreshold;
+}
@@ -0,0 +1,59 @@
+/*
+  Averaged calibration capture
+  ----------------------------------------------------------
+  Collects gravity and orientation over a time window while the sensor
+  keeps streaming. Gravity is averaged per axis, orientation with the
+  eigenvector method (dominant eigenvector of the sum of q q^T), which is
+  insensitive to the sign ambiguity of quaternions. A window with too much
+  motion, judged by the gravity variance, is rejected.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_CAPTURE_H_
+#define BNO_CAPTURE_H_
+
+#include <stdint.h>
+#include "imumaths.h"
+
+class BNO_Capture {
+public:
+	BNO_Capture() {};
+
+	// duration in microseconds
+	void start(uint64_t duration);
+	void cancel() { mActive = false; }
+	bool active() const { return mActive; }
+
+	// Add a sample, returns true when the window is complete
+	bool add(uint64_t time, const imu::Vector<3> &gravity, const imu::Quaternion &quat);
+
+	float progress() const { return mProgress; }
+	// 1 for a perfectly still capture, towards 0 with motion
+	float quality() const { return mQuality; }
+	bool accepted() const { return mAccepted; }
+
+	imu::Vector<3> gravity() const { return mGravity; }
+	imu::Quaternion quat() const { return mQuat; }
+
+	// gravity standard deviation (m/s^2) at which a capture is rejected
+	void setMotionThreshold(float threshold) { mThreshold = threshold; }
+
+private:
+	void finish();
+
+	bool mActive = false;
+	uint64_t mStart = 0, mDuration = 0;
+	int mCount = 0;
+
+	double mSum[3], mSumSq[3];
+	double mQQ[4][4]; // sum of q q^T
+
+	float mThreshold = 0.15f;
+	float mProgress = 0.f, mQuality = 0.f;
+	bool mAccepted = false;
+	imu::Vector<3> mGravity;
+	imu::Quaternion mQuat;
+};
+
+#endif /* BNO_CAPTURE_H_ */
@@ -0,0 +1,100 @@
+/*
+  Yaw drift compensation
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Drift.h"
+
+// The sensor must be still this long before the heading is locked, in us
+#define BNO_DRIFT_SETTLE 500000
+// Shorter locks don't update the drift rate, in us
+#define BNO_DRIFT_MIN_LOCK 1000000
+// Time constant of the accel variance, in seconds
+#define BNO_DRIFT_ACCEL_TAU 0.25f
+// Largest plausible drift rate, in radians per second. Anything faster
+// is slow motion mistaken for stillness.
+#define BNO_DRIFT_MAX_RATE 0.005f
+
+static inline float wrapAngle(float angle) {
+	while (angle > (float)M_PI) angle -= 2.f * (float)M_PI;
+	while (angle < -(float)M_PI) angle += 2.f * (float)M_PI;
+	return angle;
+}
+
+void BNO_Drift::reset() {
+	mYaw = 0.f;
+	mLockYaw = 0.f;
+	mLockDrift = 0.f;
+	mStill = false;
+	mLocked = false;
+}
+
+bnoQuatf_t BNO_Drift::update(uint64_t time, const float *gyro, const float *accel, const bnoQuatf_t &quat) {
+	// replayed streams can jump back when they loop
+	float dt = (mLastTime != 0 && time > mLastTime) ? (time - mLastTime) * 1e-6f : 0.f;
+	if (mLastTime == 0 || time < mLastTime) {
+		mAccelMean = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+		mAccelVar = 0.f;
+	}
+	mLastTime = time;
+
+	float g = sqrtf(gyro[0] * gyro[0] + gyro[1] * gyro[1] + gyro[2] * gyro[2]);
+	float a = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+	float alpha = fminf(1.f, dt / BNO_DRIFT_ACCEL_TAU);
+	float diff = a - mAccelMean;
+	mAccelMean += alpha * diff;
+	mAccelVar += alpha * (diff * diff - mAccelVar);
+
+	if (g < mGyroThreshold && mAccelVar < mAccelThreshold * mAccelThreshold) {
+		if (!mStill) {
+			mStill = true;
+			mStillSince = time;
+		}
+		if (!mLocked && time - mStillSince >= BNO_DRIFT_SETTLE) {
+			mLocked = true;
+			mLockTime = time;
+			mLockQuat = quat;
+			mLockYaw = mYaw;
+			mLockDrift = 0.f;
+		}
+	} else {
+		if (mLocked) {
+			endStill(time);
+		}
+		mStill = false;
+	}
+
+	if (mLocked) {
+		// Only the heading drifts, so the change since the lock is a
+		// rotation about the vertical: its angle is the drift
+		bnoQuatf_t lockConj = { mLockQuat.w, -mLockQuat.x, -mLockQuat.y, -mLockQuat.z };
+		bnoQuatf_t dq = bnoQuatMul(quat, lockConj);
+		if (dq.w < 0.f) {
+			dq.w = -dq.w;
+			dq.z = -dq.z;
+		}
+		mLockDrift = 2.f * atan2f(dq.z, dq.w);
+		mYaw = wrapAngle(mLockYaw - mLockDrift);
+	} else {
+		mYaw = wrapAngle(mYaw - mRate * dt);
+	}
+
+	bnoQuatf_t correction = { cosf(0.5f * mYaw), 0.f, 0.f, sinf(0.5f * mYaw) };
+	return bnoQuatMul(correction, quat);
+}
+
+// Fold the drift seen while locked into the rate estimate, longer still
+// periods weigh more
+void BNO_Drift::endStill(uint64_t time) {
+	mLocked = false;
+	float duration = (time - mLockTime) * 1e-6f;
+	if (duration * 1e6f < BNO_DRIFT_MIN_LOCK) {
+		return;
+	}
+	float measured = mLockDrift / duration;
+	float weight = duration / (duration + 10.f);
+	mRate += weight * (measured - mRate);
+	mRate = fmaxf(-BNO_DRIFT_MAX_RATE, fminf(BNO_DRIFT_MAX_RATE, mRate));
+}
@@ -0,0 +1,64 @@
+/*
+  Yaw drift compensation
+  ----------------------------------------------------------
+  Without the magnetometer nothing corrects the heading of the fusion
+  output, so it slowly drifts. Stillness is detected from the gyro
+  magnitude and the variance of the accelerometer. While the sensor is
+  still the heading is held, and the drift seen during the still period
+  updates an estimate of the drift rate, which is then compensated while
+  the sensor moves. The correction is a rotation about the vertical axis
+  of the chip's world frame:
+
+      corrected = rotation(yaw) * raw
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_DRIFT_H_
+#define BNO_DRIFT_H_
+
+#include <stdint.h>
+#include "BNO_Frame.h"
+
+class BNO_Drift {
+public:
+	BNO_Drift() {};
+
+	// Clear the heading correction, the drift rate estimate is kept
+	void reset();
+
+	// time in microseconds, gyro in dps, accel in m/s^2. quat is the raw
+	// fusion output, returns it with the correction applied.
+	bnoQuatf_t update(uint64_t time, const float *gyro, const float *accel, const bnoQuatf_t &quat);
+
+	bool still() const { return mStill; }
+	// radians per second
+	float rate() const { return mRate; }
+
+	// gyro magnitude (dps) and accel standard deviation (m/s^2) below which
+	// the sensor counts as still, defaults 2 and 0.1
+	void setThresholds(float gyro, float accel) { mGyroThreshold = gyro; mAccelThreshold = accel; }
+
+private:
+	void endStill(uint64_t time);
+
+	uint64_t mLastTime = 0;
+	uint64_t mStillSince = 0;
+	uint64_t mLockTime = 0;
+	bool mStill = false;
+	bool mLocked = false;
+
+	// running mean and variance of the accel magnitude
+	float mAccelMean = 0.f, mAccelVar = 0.f;
+
+	float mYaw = 0.f; // current correction, radians
+	float mLockYaw = 0.f; // correction when the heading was locked
+	float mLockDrift = 0.f; // drift since the lock
+	bnoQuatf_t mLockQuat = { 1.f, 0.f, 0.f, 0.f };
+	float mRate = 0.f;
+
+	float mGyroThreshold = 2.f;
+	float mAccelThreshold = 0.1f;
+};
+
+#endif /* BNO_DRIFT_H_ */
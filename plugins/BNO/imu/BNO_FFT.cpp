@@ -0,0 +1,74 @@
+/*
+  Real FFT
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_FFT.h"
+
+BNO_RealFFT::BNO_RealFFT(int size) : mSize(size) {
+	for (int k = 0; k < size / 2; ++k) {
+		double angle = 2.0 * M_PI * k / size;
+		mCos[k] = (float)cos(angle);
+		mSin[k] = (float)sin(angle);
+	}
+}
+
+// Iterative radix-2, bit reversed input order. The twiddles of the half
+// size FFT are every other twiddle of the full size.
+void BNO_RealFFT::complexFFT(float *re, float *im) const {
+	const int n = mSize / 2;
+	for (int i = 1, j = 0; i < n; ++i) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (int length = 2; length <= n; length <<= 1) {
+		const int half = length >> 1;
+		const int step = mSize / length;
+		for (int start = 0; start < n; start += length) {
+			for (int k = 0; k < half; ++k) {
+				float c = mCos[k * step], s = mSin[k * step];
+				int a = start + k, b = a + half;
+				// b * e^(-i angle)
+				float br = re[b] * c + im[b] * s;
+				float bi = im[b] * c - re[b] * s;
+				re[b] = re[a] - br;
+				im[b] = im[a] - bi;
+				re[a] += br;
+				im[a] += bi;
+			}
+		}
+	}
+}
+
+void BNO_RealFFT::forward(const float *in, float *re, float *im) {
+	const int n = mSize / 2;
+	for (int i = 0; i < n; ++i) {
+		mRe[i] = in[2 * i];
+		mIm[i] = in[2 * i + 1];
+	}
+	complexFFT(mRe, mIm);
+
+	// Z[k] = E[k] + i O[k], with E and O the spectra of the even and odd
+	// samples, X[k] = E[k] + e^(-2 pi i k / size) O[k]
+	for (int k = 0; k <= n; ++k) {
+		int a = k % n, b = (n - k) % n;
+		float er = 0.5f * (mRe[a] + mRe[b]);
+		float ei = 0.5f * (mIm[a] - mIm[b]);
+		float or_ = 0.5f * (mIm[a] + mIm[b]);
+		float oi = -0.5f * (mRe[a] - mRe[b]);
+		float c = k < n ? mCos[k] : -1.f;
+		float s = k < n ? mSin[k] : 0.f;
+		re[k] = er + c * or_ + s * oi;
+		im[k] = ei + c * oi - s * or_;
+	}
+}
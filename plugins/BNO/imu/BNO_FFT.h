@@ -0,0 +1,37 @@
+/*
+  Real FFT
+  ----------------------------------------------------------
+  Forward FFT of real float input, computed as a complex FFT of half the
+  size (even samples as real, odd samples as imaginary parts) and split
+  into the spectrum of the real input afterwards. The size is fixed at
+  construction, twiddles are precomputed and nothing is allocated.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_FFT_H_
+#define BNO_FFT_H_
+
+#define BNO_FFT_MAX_SIZE 1024
+
+class BNO_RealFFT {
+public:
+	// size is a power of two, from 4 to BNO_FFT_MAX_SIZE
+	explicit BNO_RealFFT(int size);
+
+	int size() const { return mSize; }
+	// Bins 0 to size / 2 of the spectrum of size real values,
+	// re and im hold size / 2 + 1 values
+	void forward(const float *in, float *re, float *im);
+
+private:
+	// In place complex FFT of size / 2 points
+	void complexFFT(float *re, float *im) const;
+
+	int mSize;
+	// cos and sin of 2 pi k / size
+	float mCos[BNO_FFT_MAX_SIZE / 2], mSin[BNO_FFT_MAX_SIZE / 2];
+	float mRe[BNO_FFT_MAX_SIZE / 2], mIm[BNO_FFT_MAX_SIZE / 2];
+};
+
+#endif /* BNO_FFT_H_ */
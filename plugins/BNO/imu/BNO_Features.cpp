@@ -0,0 +1,57 @@
+/*
+  Derived motion features
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <string.h>
+#include "BNO_Features.h"
+
+// Readings further apart than this restart the derivatives, in us
+#define BNO_FEATURES_MAX_GAP 1000000
+
+void BNO_Features::update(uint64_t time, const imu::Vector<3> &linAccel, const imu::Quaternion &quat, float *out) {
+	// Linear acceleration and jerk
+	mLinChanged = false;
+	if (mLinTime == 0 || time < mLinTime || time - mLinTime > BNO_FEATURES_MAX_GAP) {
+		mLinTime = time;
+		mLastLin = linAccel;
+		mMeanSquare = linAccel.magnitude() * linAccel.magnitude();
+		mValues[BNO_JERK] = 0.f;
+	} else if (linAccel.x() != mLastLin.x() || linAccel.y() != mLastLin.y() || linAccel.z() != mLastLin.z()) {
+		double dt = (time - mLinTime) * 1e-6;
+		double magnitude = linAccel.magnitude();
+		mValues[BNO_JERK] = (float)((linAccel - mLastLin).magnitude() / dt);
+		double a = 1.0 - exp(-dt / mActivityWindow);
+		mMeanSquare += a * (magnitude * magnitude - mMeanSquare);
+		mLinTime = time;
+		mLastLin = linAccel;
+		mLinChanged = true;
+	}
+	mValues[BNO_LINEAR_ACCEL] = (float)linAccel.magnitude();
+	mValues[BNO_ACTIVITY] = (float)sqrt(mMeanSquare);
+
+	// Angular speed and tilt
+	if (mQuatTime == 0 || time < mQuatTime || time - mQuatTime > BNO_FEATURES_MAX_GAP) {
+		mQuatTime = time;
+		mLastQuat = quat;
+		mValues[BNO_ANGULAR_SPEED] = 0.f;
+	} else if (quat.w() != mLastQuat.w() || quat.x() != mLastQuat.x()
+			|| quat.y() != mLastQuat.y() || quat.z() != mLastQuat.z()) {
+		double dt = (time - mQuatTime) * 1e-6;
+		imu::Quaternion delta = mLastQuat.conjugate() * quat;
+		// q and -q are the same rotation, take the short way
+		if (delta.w() < 0.0) {
+			delta = delta * -1.0;
+		}
+		mValues[BNO_ANGULAR_SPEED] = (float)delta.toAngularVelocity(dt).magnitude();
+		mQuatTime = time;
+		mLastQuat = quat;
+	}
+	// z component of the rotated up axis
+	double up = 1.0 - 2.0 * (quat.x() * quat.x() + quat.y() * quat.y());
+	mValues[BNO_TILT] = (float)acos(fmax(-1.0, fmin(1.0, up)));
+
+	memcpy(out, mValues, sizeof(mValues));
+}
@@ -0,0 +1,54 @@
+/*
+  Derived motion features
+  ----------------------------------------------------------
+  Kinematic features computed once per sensor frame on the reader thread
+  and published with the frame, so synths don't each rebuild them from
+  the raw outputs:
+
+      angular speed       rad/s, from successive orientations
+      linear acceleration magnitude in m/s^2, gravity removed by the chip
+      jerk                m/s^3, rate of change of the linear acceleration
+      tilt                radians between the calibrated up axis and vertical
+      activity            RMS of the linear acceleration over about half a second
+
+  The chip updates its fusion output slower than we poll it, so derivatives
+  are taken between changed readings only.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_FEATURES_H_
+#define BNO_FEATURES_H_
+
+#include <stdint.h>
+#include "imumaths.h"
+#include "BNO_Frame.h"
+
+class BNO_Features {
+public:
+	BNO_Features() {};
+
+	void reset() { mLinTime = mQuatTime = 0; }
+
+	// time in microseconds, linear acceleration in m/s^2 and the
+	// calibrated orientation. Writes BNO_NUM_FEATURES values to out.
+	void update(uint64_t time, const imu::Vector<3> &linAccel, const imu::Quaternion &quat, float *out);
+
+	// True if the last update had a new linear acceleration reading
+	bool linearChanged() const { return mLinChanged; }
+
+	// seconds, default 0.5
+	void setActivityWindow(float window) { mActivityWindow = window; }
+
+private:
+	uint64_t mLinTime = 0, mQuatTime = 0;
+	bool mLinChanged = false;
+	imu::Vector<3> mLastLin;
+	imu::Quaternion mLastQuat;
+
+	float mValues[BNO_NUM_FEATURES] = {};
+	double mMeanSquare = 0.0;
+	float mActivityWindow = 0.5f;
+};
+
+#endif /* BNO_FEATURES_H_ */
@@ -0,0 +1,220 @@
+/*
+  Smoothing filters for the published frame
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <string.h>
+#include "BNO_Filter.h"
+
+// Frames further apart than this restart the filter, in us
+#define BNO_FILTER_MAX_GAP 1000000
+// One-Euro derivative cutoff, Hz
+#define BNO_FILTER_DCUTOFF 1.f
+
+int bnoParseFilterType(const char *name) {
+	static const char *names[BNO_NUM_FILTERS] = { "none", "euro", "exp", "biquad" };
+	for (int i = 0; i < BNO_NUM_FILTERS; ++i) {
+		if (strcmp(name, names[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void BNO_FilterBase::configure(const bnoFilterConfig_t &config) {
+	mConfig = config;
+	if (mConfig.type < 0 || mConfig.type >= BNO_NUM_FILTERS) {
+		mConfig.type = BNO_FILTER_NONE;
+	}
+	mBiquadInterval = 0.f;
+	reset();
+}
+
+float BNO_FilterBase::step(uint64_t time) {
+	bool restart = mLastTime == 0 || time < mLastTime || time - mLastTime > BNO_FILTER_MAX_GAP;
+	uint64_t last = mLastTime;
+	mLastTime = time;
+	if (restart) {
+		return -1.f;
+	}
+	mDt = (time - last) * 1e-6f;
+	if (mDt > 0.f) {
+		mInterval = mInterval > 0.f ? mInterval + 0.05f * (mDt - mInterval) : mDt;
+	}
+	return mDt;
+}
+
+float BNO_FilterBase::alpha(float cutoff) const {
+	float tau = 1.f / (2.f * (float)M_PI * cutoff);
+	return 1.f / (1.f + tau / mDt);
+}
+
+// Coefficients only follow larger changes of the frame rate
+void BNO_FilterBase::updateBiquad() {
+	if (mBiquadInterval > 0.f && fabsf(mInterval - mBiquadInterval) < 0.05f * mBiquadInterval) {
+		return;
+	}
+	mBiquadInterval = mInterval;
+	float rate = 1.f / mInterval;
+	float cutoff = fminf(mConfig.cutoff, 0.45f * rate);
+	float q = mConfig.param > 0.f ? mConfig.param : (float)M_SQRT1_2;
+	float w0 = 2.f * (float)M_PI * cutoff / rate;
+	float cw = cosf(w0);
+	float a = sinf(w0) / (2.f * q);
+	float a0 = 1.f + a;
+	mB0 = 0.5f * (1.f - cw) / a0;
+	mB1 = (1.f - cw) / a0;
+	mB2 = mB0;
+	mA1 = -2.f * cw / a0;
+	mA2 = (1.f - a) / a0;
+}
+
+void BNO_VectorFilter::process(uint64_t time, float *v) {
+	if (!active()) {
+		return;
+	}
+	float dt = step(time);
+	if (dt < 0.f) {
+		// start from the input
+		for (int i = 0; i < 3; ++i) {
+			mX1[i] = mX2[i] = mY1[i] = mY2[i] = mS[i] = v[i];
+			mDx[i] = 0.f;
+		}
+		return;
+	}
+	if (dt == 0.f) {
+		// repeated frame
+		memcpy(v, mY1, sizeof(mY1));
+		return;
+	}
+
+	switch (mConfig.type) {
+	case BNO_FILTER_ONE_EURO: {
+		float ad = alpha(BNO_FILTER_DCUTOFF);
+		float speed = 0.f;
+		for (int i = 0; i < 3; ++i) {
+			mDx[i] += ad * ((v[i] - mY1[i]) / dt - mDx[i]);
+			speed += mDx[i] * mDx[i];
+		}
+		float a = alpha(mConfig.cutoff + mConfig.param * sqrtf(speed));
+		for (int i = 0; i < 3; ++i) {
+			mY1[i] += a * (v[i] - mY1[i]);
+			v[i] = mY1[i];
+		}
+		break;
+	}
+	case BNO_FILTER_EXP: {
+		float a = alpha(mConfig.cutoff);
+		for (int i = 0; i < 3; ++i) {
+			mS[i] += a * (v[i] - mS[i]);
+			mY1[i] += a * (mS[i] - mY1[i]);
+			v[i] = mY1[i];
+		}
+		break;
+	}
+	case BNO_FILTER_BIQUAD:
+		updateBiquad();
+		for (int i = 0; i < 3; ++i) {
+			float y = mB0 * v[i] + mB1 * mX1[i] + mB2 * mX2[i] - mA1 * mY1[i] - mA2 * mY2[i];
+			mX2[i] = mX1[i];
+			mX1[i] = v[i];
+			mY2[i] = mY1[i];
+			mY1[i] = y;
+			v[i] = y;
+		}
+		break;
+	}
+}
+
+// Tangent space of the unit quaternions: log gives half the rotation vector
+static inline void quatLog(const bnoQuatf_t &q, float *v) {
+	float s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+	float k = s > 1e-9f ? atan2f(s, q.w) / s : 1.f;
+	v[0] = k * q.x;
+	v[1] = k * q.y;
+	v[2] = k * q.z;
+}
+
+static inline bnoQuatf_t quatExp(const float *v) {
+	float angle = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	float k = angle > 1e-9f ? sinf(angle) / angle : 1.f;
+	bnoQuatf_t q = { cosf(angle), k * v[0], k * v[1], k * v[2] };
+	return q;
+}
+
+// p relative to the anchor, in the tangent space at the anchor
+static inline void quatRelative(const bnoQuatf_t &anchor, const bnoQuatf_t &p, float *v) {
+	bnoQuatf_t conj = { anchor.w, -anchor.x, -anchor.y, -anchor.z };
+	bnoQuatf_t d = bnoQuatMul(conj, p);
+	// q and -q are the same rotation, take the short way
+	if (d.w < 0.f) {
+		d.w = -d.w; d.x = -d.x; d.y = -d.y; d.z = -d.z;
+	}
+	quatLog(d, v);
+}
+
+static inline bnoQuatf_t quatSlerp(const bnoQuatf_t &from, const bnoQuatf_t &to, float t) {
+	float v[3];
+	quatRelative(from, to, v);
+	for (int i = 0; i < 3; ++i) {
+		v[i] *= t;
+	}
+	return bnoQuatMul(from, quatExp(v));
+}
+
+void BNO_QuatFilter::process(uint64_t time, bnoQuatf_t &q) {
+	if (!active()) {
+		return;
+	}
+	float dt = step(time);
+	if (dt < 0.f) {
+		mX1 = mX2 = mY1 = mY2 = mS = q;
+		mSpeed = 0.f;
+		return;
+	}
+	if (dt == 0.f) {
+		q = mY1;
+		return;
+	}
+
+	switch (mConfig.type) {
+	case BNO_FILTER_ONE_EURO: {
+		float v[3];
+		quatRelative(mY1, q, v);
+		// log is half the rotation
+		float speed = 2.f * sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) / dt;
+		mSpeed += alpha(BNO_FILTER_DCUTOFF) * (speed - mSpeed);
+		mY1 = quatSlerp(mY1, q, alpha(mConfig.cutoff + mConfig.param * mSpeed));
+		q = mY1;
+		break;
+	}
+	case BNO_FILTER_EXP: {
+		float a = alpha(mConfig.cutoff);
+		mS = quatSlerp(mS, q, a);
+		mY1 = quatSlerp(mY1, mS, a);
+		q = mY1;
+		break;
+	}
+	case BNO_FILTER_BIQUAD: {
+		// The difference equation runs in the tangent space at the previous
+		// output, where it is zero
+		updateBiquad();
+		float x0[3], x1[3], x2[3], y2[3], y[3];
+		quatRelative(mY1, q, x0);
+		quatRelative(mY1, mX1, x1);
+		quatRelative(mY1, mX2, x2);
+		quatRelative(mY1, mY2, y2);
+		for (int i = 0; i < 3; ++i) {
+			y[i] = mB0 * x0[i] + mB1 * x1[i] + mB2 * x2[i] - mA2 * y2[i];
+		}
+		mX2 = mX1;
+		mX1 = q;
+		mY2 = mY1;
+		mY1 = bnoQuatMul(mY1, quatExp(y));
+		q = mY1;
+		break;
+	}
+	}
+}
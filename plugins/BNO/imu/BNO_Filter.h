@@ -0,0 +1,90 @@
+/*
+  Smoothing filters for the published frame
+  ----------------------------------------------------------
+  Applied once per frame on the reader thread, so every consumer shares
+  the same filtered stream. Each value type has its own filter:
+
+      One-Euro     low-pass whose cutoff rises with speed, for little
+                   jitter when still and little lag when moving
+      Exponential  two cascaded one-pole low-passes, critically damped
+      Biquad       second order low-pass (RBJ cookbook)
+
+  Vectors are filtered per axis. Quaternions are filtered on the unit
+  sphere: every step happens in the tangent space at the previous output,
+  so the result is always a rotation and there is no sign flip trouble.
+
+  Sensor timing is not exact, so the filters work from the frame
+  timestamps rather than a fixed rate.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_FILTER_H_
+#define BNO_FILTER_H_
+
+#include <stdint.h>
+#include "BNO_Frame.h"
+
+enum bnoFilterType {
+	BNO_FILTER_NONE = 0,
+	BNO_FILTER_ONE_EURO,
+	BNO_FILTER_EXP,
+	BNO_FILTER_BIQUAD,
+	BNO_NUM_FILTERS
+};
+
+typedef struct {
+	int type;     // bnoFilterType
+	float cutoff; // Hz. Minimum cutoff for One-Euro.
+	float param;  // One-Euro: speed coefficient (beta), Biquad: Q, unused otherwise
+} bnoFilterConfig_t;
+
+// Parse a filter name ("none", "euro", "exp", "biquad"), -1 if unknown
+int bnoParseFilterType(const char *name);
+
+// Frame timing and coefficients shared by the vector and quaternion filters
+class BNO_FilterBase {
+public:
+	void configure(const bnoFilterConfig_t &config);
+	bool active() const { return mConfig.type != BNO_FILTER_NONE; }
+	void reset() { mLastTime = 0; }
+
+protected:
+	// Seconds since the last frame, negative if the filter should restart
+	float step(uint64_t time);
+	// One-pole coefficient for cutoff at the current frame interval
+	float alpha(float cutoff) const;
+	void updateBiquad();
+
+	bnoFilterConfig_t mConfig = { BNO_FILTER_NONE, 1.f, 0.f };
+	uint64_t mLastTime = 0;
+	float mDt = 0.f;
+	float mInterval = 0.f; // smoothed frame interval for the biquad
+	float mBiquadInterval = 0.f; // interval the coefficients were made for
+	float mB0 = 1.f, mB1 = 0.f, mB2 = 0.f, mA1 = 0.f, mA2 = 0.f;
+};
+
+class BNO_VectorFilter : public BNO_FilterBase {
+public:
+	// Filter a 3-vector in place
+	void process(uint64_t time, float *v);
+
+private:
+	float mX1[3], mX2[3]; // previous inputs
+	float mY1[3], mY2[3]; // previous outputs
+	float mDx[3]; // One-Euro: filtered derivative
+	float mS[3]; // Exponential: first stage
+};
+
+class BNO_QuatFilter : public BNO_FilterBase {
+public:
+	// Filter a unit quaternion in place
+	void process(uint64_t time, bnoQuatf_t &q);
+
+private:
+	bnoQuatf_t mX1, mX2, mY1, mY2;
+	bnoQuatf_t mS;
+	float mSpeed = 0.f; // One-Euro: filtered angular speed, rad/s
+};
+
+#endif /* BNO_FILTER_H_ */
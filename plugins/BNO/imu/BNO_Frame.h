@@ -0,0 +1,150 @@
+/*
+  Published BNO055 frames
+  ----------------------------------------------------------
+  Frames are kept as raw int16 sensor values all the way to the consumer,
+  which scales them to float once, using the scale for the value type.
+  The orientation is published as the calibrated quaternion in the same
+  fixed point format as the chip (1 = 2^14 LSB). Derived features are
+  computed by the reader and published as float.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_FRAME_H_
+#define BNO_FRAME_H_
+
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Value types of a frame, used to look up the scale
+enum bnoValueType {
+	BNO_ACCEL = 0,
+	BNO_GYRO,
+	BNO_MAG,
+	BNO_QUAT,
+	BNO_NUM_TYPES
+};
+
+// Units per LSB for each value type (see section 3.6.4 and 3.6.5.5)
+static const float bnoScale[BNO_NUM_TYPES] = {
+	1.f / 100.f,   // m/s^2
+	1.f / 16.f,    // dps
+	1.f / 16.f,    // uT
+	1.f / 16384.f  // unit quaternion
+};
+
+#define BNO_QUAT_ONE 16384
+
+// Derived features published with each frame, see BNO_Features.h
+enum bnoFeature {
+	BNO_ANGULAR_SPEED = 0, // rad/s
+	BNO_LINEAR_ACCEL,      // m/s^2
+	BNO_JERK,              // m/s^3
+	BNO_TILT,              // radians from vertical
+	BNO_ACTIVITY,          // m/s^2 RMS
+	BNO_NUM_FEATURES
+};
+
+// On-chip interrupts, counted in each frame
+enum bnoInterrupt {
+	BNO_INT_ANY_MOTION = 0,
+	BNO_INT_NO_MOTION,
+	BNO_INT_HIGH_G,
+	BNO_INT_HIGH_RATE,
+	BNO_NUM_INTERRUPTS
+};
+
+typedef struct {
+	uint64_t time;     // microseconds, monotonic
+	int16_t accel[3];
+	int16_t gyro[3];
+	int16_t mag[3];
+	int16_t quat[4];   // calibrated orientation, w x y z
+	uint8_t calib;     // CALIB_STAT register
+	uint8_t pad;
+	float features[BNO_NUM_FEATURES];
+	// last detected onset, see BNO_Onset.h
+	uint32_t onsetCount;
+	float onsetStrength; // m/s^2
+	uint64_t onsetTime;  // microseconds, monotonic
+	// wrapping count of each bnoInterrupt
+	uint8_t interruptCounts[BNO_NUM_INTERRUPTS];
+} bnoFrame_t;
+
+// Scale count raw values of type to float
+static inline void bnoScaleValues(const int16_t *in, float *out, int count, bnoValueType type) {
+	const float scale = bnoScale[type];
+	for (int i = 0; i < count; ++i) {
+		out[i] = in[i] * scale;
+	}
+}
+
+// Euler angles (yaw, pitch, roll) of a raw quaternion, same convention as imu::Quaternion::toEuler
+static inline void bnoQuatToEuler(const int16_t *q, float *ypr) {
+	float w = q[0], x = q[1], y = q[2], z = q[3];
+	float sqw = w*w, sqx = x*x, sqy = y*y, sqz = z*z;
+	ypr[0] = atan2f(2.f*(x*y + z*w), (sqx - sqy - sqz + sqw));
+	ypr[1] = asinf(fmaxf(-1.f, fminf(1.f, -2.f*(x*z - y*w) / (sqx + sqy + sqz + sqw))));
+	ypr[2] = atan2f(2.f*(y*z + x*w), (-sqx - sqy + sqz + sqw));
+}
+
+// Float quaternion for the reader hot path
+typedef struct {
+	float w, x, y, z;
+} bnoQuatf_t;
+
+static inline bnoQuatf_t bnoQuatMul(const bnoQuatf_t &a, const bnoQuatf_t &b) {
+	bnoQuatf_t r;
+	r.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+	r.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+	r.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+	r.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+	return r;
+}
+
+// Single writer, many readers. Readers retry while a write is in progress.
+#define BNO_FRAME_WORDS ((sizeof(bnoFrame_t) + 3) / 4)
+
+typedef struct {
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> words[BNO_FRAME_WORDS];
+} bnoState_t;
+
+static inline void bnoPublish(bnoState_t &state, const bnoFrame_t &frame) {
+	uint32_t words[BNO_FRAME_WORDS];
+	memcpy(words, &frame, sizeof(bnoFrame_t));
+	uint32_t seq = state.seq.load(std::memory_order_relaxed);
+	state.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (unsigned i = 0; i < BNO_FRAME_WORDS; ++i) {
+		state.words[i].store(words[i], std::memory_order_relaxed);
+	}
+	state.seq.store(seq + 2, std::memory_order_release);
+}
+
+// Returns false if no consistent frame could be read, or nothing has been published yet
+static inline bool bnoRead(const bnoState_t &state, bnoFrame_t &frame) {
+	uint32_t words[BNO_FRAME_WORDS];
+	for (int attempt = 0; attempt < 4; ++attempt) {
+		uint32_t seq = state.seq.load(std::memory_order_acquire);
+		if (seq == 0) {
+			return false;
+		}
+		if (seq & 1) {
+			continue;
+		}
+		for (unsigned i = 0; i < BNO_FRAME_WORDS; ++i) {
+			words[i] = state.words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (state.seq.load(std::memory_order_relaxed) == seq) {
+			memcpy(&frame, words, sizeof(bnoFrame_t));
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif /* BNO_FRAME_H_ */
@@ -0,0 +1,159 @@
+/*
+  Gesture recognition by dynamic time warping
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <string.h>
+#include "BNO_Gesture.h"
+
+static const float INF = 1e30f;
+
+static inline float distance(const float *a, const float *b) {
+	float sum = 0.f;
+	for (int k = 0; k < BNO_GESTURE_DIM; ++k) {
+		float d = a[k] - b[k];
+		sum += d * d;
+	}
+	return sqrtf(sum);
+}
+
+BNO_Gesture::BNO_Gesture() {
+	for (int i = 0; i < BNO_GESTURE_MAX_TEMPLATES; ++i) {
+		mTemplates[i].length = 0;
+	}
+}
+
+void BNO_Gesture::resetTemplate(bnoTemplate_t &t) {
+	for (int i = 0; i <= t.length; ++i) {
+		t.cost[i] = INF;
+		t.start[i] = 0;
+	}
+	t.best = INF;
+	t.bestStart = t.bestEnd = 0;
+}
+
+void BNO_Gesture::startRecording(int id) {
+	if (id < 0 || id >= BNO_GESTURE_MAX_TEMPLATES) {
+		return;
+	}
+	mRecording = id;
+	mTemplates[id].length = 0;
+}
+
+bool BNO_Gesture::stopRecording() {
+	if (mRecording < 0) {
+		return false;
+	}
+	bnoTemplate_t &t = mTemplates[mRecording];
+	mRecording = -1;
+	if (t.length < BNO_GESTURE_MIN_LENGTH) {
+		t.length = 0;
+		return false;
+	}
+	resetTemplate(t);
+	return true;
+}
+
+void BNO_Gesture::clear(int id) {
+	for (int i = 0; i < BNO_GESTURE_MAX_TEMPLATES; ++i) {
+		if (id < 0 || id == i) {
+			mTemplates[i].length = 0;
+		}
+	}
+}
+
+bool BNO_Gesture::add(const float *sample) {
+	mTime++;
+	if (mRecording >= 0) {
+		// templates are not matched while recording
+		bnoTemplate_t &t = mTemplates[mRecording];
+		if (t.length < BNO_GESTURE_MAX_LENGTH) {
+			memcpy(t.data[t.length++], sample, sizeof(t.data[0]));
+		}
+		return false;
+	}
+
+	// the best of simultaneous matches wins
+	bool matched = false;
+	for (int i = 0; i < BNO_GESTURE_MAX_TEMPLATES; ++i) {
+		float cost;
+		int length;
+		if (mTemplates[i].length > 0 && update(mTemplates[i], sample, cost, length)) {
+			float confidence = 1.f - cost / (mThreshold * mTemplates[i].length);
+			if (!matched || confidence > mMatchConfidence) {
+				mMatchId = i;
+				mMatchConfidence = confidence;
+				mMatchLength = length;
+				matched = true;
+			}
+		}
+	}
+	return matched;
+}
+
+// One SPRING step. cost[0] stays 0, so a path can start at any sample.
+bool BNO_Gesture::update(bnoTemplate_t &t, const float *sample, float &cost, int &length) {
+	const int m = t.length;
+	const float epsilon = mThreshold * m;
+
+	float diag = 0.f; // cost[i - 1] of the previous column
+	int64_t diagStart = mTime;
+	float left = 0.f; // cost[i - 1] of this column
+	int64_t leftStart = mTime;
+	for (int i = 1; i <= m; ++i) {
+		float up = t.cost[i]; // previous column, same row
+		float best = left;
+		int64_t start = leftStart;
+		if (diag <= best) {
+			best = diag;
+			start = diagStart;
+		}
+		if (up < best) {
+			best = up;
+			start = t.start[i];
+		}
+		diag = up;
+		diagStart = t.start[i];
+
+		// costs only grow along a path, so abandon cells that can't match
+		if (best >= epsilon) {
+			t.cost[i] = INF;
+		} else {
+			t.cost[i] = best + distance(sample, t.data[i - 1]);
+			t.start[i] = start;
+		}
+		left = t.cost[i];
+		leftStart = t.start[i];
+	}
+
+	// Report the best match once no open path overlapping it can beat it
+	bool report = false;
+	if (t.best <= epsilon) {
+		report = true;
+		for (int i = 1; i <= m; ++i) {
+			if (t.cost[i] < t.best && t.start[i] <= t.bestEnd) {
+				report = false;
+				break;
+			}
+		}
+		if (report) {
+			cost = t.best;
+			length = (int)(t.bestEnd - t.bestStart + 1);
+			// paths overlapping the match can't report it again
+			for (int i = 1; i <= m; ++i) {
+				if (t.start[i] <= t.bestEnd) {
+					t.cost[i] = INF;
+				}
+			}
+			t.best = INF;
+		}
+	}
+	if (t.cost[m] <= epsilon && t.cost[m] < t.best) {
+		t.best = t.cost[m];
+		t.bestStart = t.start[m];
+		t.bestEnd = mTime;
+	}
+	return report;
+}
@@ -0,0 +1,80 @@
+/*
+  Gesture recognition by dynamic time warping
+  ----------------------------------------------------------
+  Templates are recorded from the sensor stream and then searched for in
+  the live stream with subsequence DTW (the SPRING algorithm: Sakurai,
+  Faloutsos and Yamamuro, "Stream monitoring under the time warping
+  distance", 2007). Every template keeps one column of the warping matrix,
+  so each new sample costs one column update per template, and a match is
+  reported as soon as no later path can improve on it.
+
+  Cells whose cost is already above the match threshold can't lead to a
+  match, so their distance is never computed. While nothing resembles a
+  template only the first cells of its column are evaluated.
+
+  Samples are feature vectors of BNO_GESTURE_DIM values at a fixed rate,
+  see BNO_Service.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_GESTURE_H_
+#define BNO_GESTURE_H_
+
+#include <stdint.h>
+
+#define BNO_GESTURE_DIM 6
+#define BNO_GESTURE_MAX_TEMPLATES 8
+#define BNO_GESTURE_MAX_LENGTH 128
+#define BNO_GESTURE_MIN_LENGTH 8
+
+class BNO_Gesture {
+public:
+	BNO_Gesture();
+
+	// Record template id from the following samples, replacing any old one
+	void startRecording(int id);
+	// Returns false if the recording was too short to keep
+	bool stopRecording();
+	bool recording() const { return mRecording >= 0; }
+	// id -1 clears all templates
+	void clear(int id);
+
+	// A new sample, returns true if it completed a match
+	bool add(const float *sample);
+
+	// Last match
+	int matchId() const { return mMatchId; }
+	// 1 for a perfect match, 0 at the threshold
+	float matchConfidence() const { return mMatchConfidence; }
+	int matchLength() const { return mMatchLength; }
+
+	// Mean distance per template sample at which a match is accepted, default 0.25
+	void setThreshold(float threshold) { mThreshold = threshold; }
+
+private:
+	typedef struct {
+		int length; // 0 if unused
+		float data[BNO_GESTURE_MAX_LENGTH][BNO_GESTURE_DIM];
+		// SPRING state: warping cost and start time of the best path to each cell
+		float cost[BNO_GESTURE_MAX_LENGTH + 1];
+		int64_t start[BNO_GESTURE_MAX_LENGTH + 1];
+		float best; // best match so far, not yet reported
+		int64_t bestStart, bestEnd;
+	} bnoTemplate_t;
+
+	void resetTemplate(bnoTemplate_t &t);
+	// cost and length of a reported match
+	bool update(bnoTemplate_t &t, const float *sample, float &cost, int &length);
+
+	bnoTemplate_t mTemplates[BNO_GESTURE_MAX_TEMPLATES];
+	int mRecording = -1;
+	int64_t mTime = 0;
+
+	int mMatchId = -1;
+	float mMatchConfidence = 0.f;
+	int mMatchLength = 0;
+	float mThreshold = 0.25f;
+};
+
+#endif /* BNO_GESTURE_H_ */
@@ -0,0 +1,266 @@
+/*
+  Event log
+
+  Johannes Burström 2021
+*/
+
+#include <atomic>
+#include <thread>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#include "BNO_Log.h"
+
+#define BNO_LOG_SIZE 256             // events, a power of two
+#define BNO_LOG_INTERVAL 100000      // us between drains
+#define BNO_LOG_REPEAT_INTERVAL 1000000 // us
+
+typedef struct {
+	int code;
+	int32_t a, b;
+} bnoLogEvent_t;
+
+// Bounded multi-producer ring, one consumer. A slot is free for the
+// producer of position pos when its sequence is pos, and holds the event
+// for the consumer when it is pos + 1. The sequence is stored relative to
+// the slot index, so the zero initialised ring is empty and usable before
+// any constructor has run.
+typedef struct {
+	std::atomic<uint32_t> seq;
+	bnoLogEvent_t event;
+} bnoLogSlot_t;
+
+static bnoLogSlot_t gSlots[BNO_LOG_SIZE];
+static std::atomic<uint32_t> gHead;
+static std::atomic<uint32_t> gTail;
+static std::atomic<uint32_t> gDropped;
+static std::atomic<uint32_t> gCounts[BNO_NUM_LOG_CODES];
+
+static inline uint32_t slotSeq(uint32_t index) {
+	return gSlots[index].seq.load(std::memory_order_acquire) + index;
+}
+
+static inline void setSlotSeq(uint32_t index, uint32_t seq) {
+	gSlots[index].seq.store(seq - index, std::memory_order_release);
+}
+
+void bnoLog(int code, int32_t a, int32_t b)
+{
+	if (code < 0 || code >= BNO_NUM_LOG_CODES) {
+		return;
+	}
+	gCounts[code].fetch_add(1, std::memory_order_relaxed);
+
+	uint32_t pos = gHead.load(std::memory_order_relaxed);
+	for (;;) {
+		uint32_t index = pos & (BNO_LOG_SIZE - 1);
+		int32_t dif = (int32_t)(slotSeq(index) - pos);
+		if (dif == 0) {
+			if (gHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				gSlots[index].event = { code, a, b };
+				setSlotSeq(index, pos + 1);
+				return;
+			}
+		} else if (dif < 0) {
+			gDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = gHead.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+uint32_t bnoLogCount(int code)
+{
+	if (code < 0 || code >= BNO_NUM_LOG_CODES) {
+		return 0;
+	}
+	return gCounts[code].load(std::memory_order_relaxed);
+}
+
+static bool popEvent(bnoLogEvent_t &event)
+{
+	uint32_t pos = gTail.load(std::memory_order_relaxed);
+	uint32_t index = pos & (BNO_LOG_SIZE - 1);
+	if (slotSeq(index) != pos + 1) {
+		return false;
+	}
+	event = gSlots[index].event;
+	setSlotSeq(index, pos + BNO_LOG_SIZE);
+	gTail.store(pos + 1, std::memory_order_relaxed);
+	return true;
+}
+
+// collapsed: number of events of the code this line stands for, the last
+// of which is event. 0 for just the one.
+static void printEvent(const bnoLogEvent_t &event, uint32_t collapsed)
+{
+	char text[128];
+	switch (event.code) {
+	case BNO_LOG_I2C_READ:
+		snprintf(text, sizeof(text), "I2C read of register 0x%02x failed: %d", event.a, event.b);
+		break;
+	case BNO_LOG_I2C_WRITE:
+		snprintf(text, sizeof(text), "Failed to write register 0x%02x", event.a);
+		break;
+	case BNO_LOG_CALIBRATE:
+		snprintf(text, sizeof(text), "Calibrating");
+		break;
+	case BNO_LOG_CAL_NEUTRAL:
+		snprintf(text, sizeof(text), "Calibrating, neutral position");
+		break;
+	case BNO_LOG_CAL_DOWN:
+		snprintf(text, sizeof(text), "Calibrating, tilted down");
+		break;
+	case BNO_LOG_CAL_MOTION:
+		snprintf(text, sizeof(text), "Too much motion during calibration, retrying");
+		break;
+	case BNO_LOG_CAL_FAILED:
+		snprintf(text, sizeof(text), "Calibration failed, too much motion in %d attempts", event.a);
+		break;
+	case BNO_LOG_CAL_DONE:
+		snprintf(text, sizeof(text), "Calibrated, running");
+		break;
+	case BNO_LOG_SAVED:
+		snprintf(text, sizeof(text), event.b ? "Saved calibration %d" : "Couldn't save calibration %d", event.a);
+		break;
+	case BNO_LOG_LOADED:
+		snprintf(text, sizeof(text), event.b ? "Loaded calibration %d" : "No calibration %d", event.a);
+		break;
+	case BNO_LOG_OFFSETS_RESTORED:
+		snprintf(text, sizeof(text), "Restored BNO055 sensor offsets");
+		break;
+	case BNO_LOG_FULLY_CALIBRATED:
+		snprintf(text, sizeof(text), "BNO055 fully calibrated, sensor offsets captured");
+		break;
+	case BNO_LOG_GESTURE_RECORD:
+		snprintf(text, sizeof(text), "Recording gesture %d", event.a);
+		break;
+	case BNO_LOG_GESTURE_SHORT:
+		snprintf(text, sizeof(text), "Gesture too short");
+		break;
+	case BNO_LOG_ZONE_DROPPED:
+		snprintf(text, sizeof(text), "Command queue full, zone %d wasn't fully updated", event.a);
+		break;
+	case BNO_LOG_MAG_COLLECT:
+		snprintf(text, sizeof(text), "Collecting magnetometer samples");
+		break;
+	case BNO_LOG_MAG_FIT:
+		snprintf(text, sizeof(text), "Magnetometer fit from %d points, offset %.1f uT", event.b, event.a * 0.1f);
+		break;
+	case BNO_LOG_RECORD_FAILED:
+		snprintf(text, sizeof(text), "Couldn't open the recording file");
+		break;
+	default:
+		return;
+	}
+	if (collapsed > 1) {
+		printf("BNO: %s (%u times)\n", text, collapsed);
+	} else {
+		printf("BNO: %s\n", text);
+	}
+}
+
+static uint64_t logTimeUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+class BNO_Logger {
+public:
+	BNO_Logger() : mStop(false) {}
+	~BNO_Logger() { stop(); }
+
+	void start()
+	{
+		if (mThread == nullptr) {
+			mStop = false;
+			mThread = new std::thread(&BNO_Logger::run, this);
+		}
+	}
+
+	void stop()
+	{
+		if (mThread && mThread->joinable()) {
+			mStop = true;
+			mThread->join();
+		}
+		delete mThread;
+		mThread = nullptr;
+	}
+
+private:
+	// Per code: when it was last printed, and what came since
+	typedef struct {
+		uint64_t lastPrint;
+		uint32_t repeats;
+		bnoLogEvent_t last;
+	} codeState_t;
+
+	void run()
+	{
+#ifdef __linux__
+		// nice applies to the calling thread on Linux
+		setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+		while (!mStop) {
+			drain();
+			usleep(BNO_LOG_INTERVAL);
+		}
+		drain();
+	}
+
+	void drain()
+	{
+		uint64_t now = logTimeUs();
+		bnoLogEvent_t event;
+		while (popEvent(event)) {
+			codeState_t &state = mCodes[event.code];
+			if (state.lastPrint == 0 || now - state.lastPrint >= BNO_LOG_REPEAT_INTERVAL) {
+				printEvent(event, 0);
+				state.lastPrint = now;
+			} else {
+				state.repeats++;
+				state.last = event;
+			}
+		}
+		// one line for everything collapsed since the last print
+		for (int code = 0; code < BNO_NUM_LOG_CODES; ++code) {
+			codeState_t &state = mCodes[code];
+			if (state.repeats > 0 && (now - state.lastPrint >= BNO_LOG_REPEAT_INTERVAL || mStop)) {
+				printEvent(state.last, state.repeats);
+				state.repeats = 0;
+				state.lastPrint = now;
+			}
+		}
+		uint32_t dropped = gDropped.load(std::memory_order_relaxed);
+		if (dropped != mDropped) {
+			printf("BNO: %u log events dropped\n", dropped - mDropped);
+			mDropped = dropped;
+		}
+		fflush(stdout);
+	}
+
+	codeState_t mCodes[BNO_NUM_LOG_CODES] = {};
+	uint32_t mDropped = 0;
+	std::atomic<bool> mStop;
+	std::thread *mThread = nullptr;
+};
+
+static BNO_Logger gLogger;
+
+void bnoLogStart()
+{
+	gLogger.start();
+}
+
+void bnoLogStop()
+{
+	gLogger.stop();
+}
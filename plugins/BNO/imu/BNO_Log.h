@@ -0,0 +1,53 @@
+/*
+  Event log
+  ----------------------------------------------------------
+  The audio thread and the sensor reader must not block on the console,
+  so they report events as a code with two integer arguments instead of
+  printing. bnoLog() only writes the event into a preallocated lock-free
+  ring and counts it; a low priority thread formats and prints. Events
+  of a code that come less than a second after the last one printed are
+  collapsed into one line with their number, so a flaky bus can't flood
+  the console.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_LOG_H_
+#define BNO_LOG_H_
+
+#include <stdint.h>
+
+enum bnoLogCode {
+	BNO_LOG_I2C_READ,         // a: register, b: ioctl result
+	BNO_LOG_I2C_WRITE,        // a: register
+	BNO_LOG_CALIBRATE,        // a: calibration triggers in a block
+	BNO_LOG_CAL_NEUTRAL,
+	BNO_LOG_CAL_DOWN,
+	BNO_LOG_CAL_MOTION,
+	BNO_LOG_CAL_FAILED,       // a: attempts
+	BNO_LOG_CAL_DONE,
+	BNO_LOG_SAVED,            // a: profile, b: 1 on success
+	BNO_LOG_LOADED,           // a: profile, b: 1 on success
+	BNO_LOG_OFFSETS_RESTORED,
+	BNO_LOG_FULLY_CALIBRATED,
+	BNO_LOG_GESTURE_RECORD,   // a: template
+	BNO_LOG_GESTURE_SHORT,
+	BNO_LOG_ZONE_DROPPED,     // a: zone
+	BNO_LOG_MAG_COLLECT,
+	BNO_LOG_MAG_FIT,          // a: offset magnitude in 0.1 uT, b: points
+	BNO_LOG_RECORD_FAILED,
+	BNO_NUM_LOG_CODES
+};
+
+// Any thread. Never blocks, allocates or formats; the event is dropped
+// if the ring is full, but still counted.
+void bnoLog(int code, int32_t a = 0, int32_t b = 0);
+// Number of events of code so far
+uint32_t bnoLogCount(int code);
+
+// Start and stop the thread that prints the events. Events logged before
+// it starts are printed when it does, as far as they fit in the ring.
+void bnoLogStart();
+void bnoLogStop();
+
+#endif /* BNO_LOG_H_ */
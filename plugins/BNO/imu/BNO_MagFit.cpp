@@ -0,0 +1,231 @@
+/*
+  Magnetometer hard/soft-iron calibration
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <string.h>
+#include "BNO_MagFit.h"
+
+// Solve a x = b in place for an n x n system, with partial pivoting
+static bool solve(double a[9][9], double b[9], int n) {
+	for (int col = 0; col < n; ++col) {
+		int pivot = col;
+		for (int row = col + 1; row < n; ++row) {
+			if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+				pivot = row;
+			}
+		}
+		if (fabs(a[pivot][col]) < 1e-12) {
+			return false;
+		}
+		if (pivot != col) {
+			for (int k = 0; k < n; ++k) {
+				double t = a[col][k]; a[col][k] = a[pivot][k]; a[pivot][k] = t;
+			}
+			double t = b[col]; b[col] = b[pivot]; b[pivot] = t;
+		}
+		for (int row = col + 1; row < n; ++row) {
+			double f = a[row][col] / a[col][col];
+			for (int k = col; k < n; ++k) {
+				a[row][k] -= f * a[col][k];
+			}
+			b[row] -= f * b[col];
+		}
+	}
+	for (int row = n - 1; row >= 0; --row) {
+		double sum = b[row];
+		for (int k = row + 1; k < n; ++k) {
+			sum -= a[row][k] * b[k];
+		}
+		b[row] = sum / a[row][row];
+	}
+	return true;
+}
+
+// Jacobi eigendecomposition of a symmetric 3x3 matrix: m = v diag(e) v^T
+static void eigenSymmetric3(const double m[3][3], double e[3], double v[3][3]) {
+	double a[3][3];
+	memcpy(a, m, sizeof(a));
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			v[i][j] = (i == j) ? 1.0 : 0.0;
+		}
+	}
+	for (int sweep = 0; sweep < 32; ++sweep) {
+		double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+		if (off < 1e-15) {
+			break;
+		}
+		for (int p = 0; p < 2; ++p) {
+			for (int q = p + 1; q < 3; ++q) {
+				if (fabs(a[p][q]) < 1e-18) {
+					continue;
+				}
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < 3; ++k) {
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; ++k) {
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; ++k) {
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+	for (int i = 0; i < 3; ++i) {
+		e[i] = a[i][i];
+	}
+}
+
+void BNO_MagFit::reset() {
+	mNumPoints = 0;
+	mNext = 0;
+	mNewPoints = 0;
+}
+
+bool BNO_MagFit::add(const float *mag) {
+	const float minSq = mMinDistance * mMinDistance;
+	for (int i = 0; i < mNumPoints; ++i) {
+		float dx = mPoints[i][0] - mag[0];
+		float dy = mPoints[i][1] - mag[1];
+		float dz = mPoints[i][2] - mag[2];
+		if (dx * dx + dy * dy + dz * dz < minSq) {
+			return false;
+		}
+	}
+
+	int index;
+	if (mNumPoints < BNO_MAGFIT_MAX_POINTS) {
+		index = mNumPoints++;
+	} else {
+		index = mNext;
+		mNext = (mNext + 1) % BNO_MAGFIT_MAX_POINTS;
+	}
+	mPoints[index][0] = mag[0];
+	mPoints[index][1] = mag[1];
+	mPoints[index][2] = mag[2];
+	mNewPoints++;
+	return true;
+}
+
+// Fits A x^2 + B y^2 + C z^2 + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z = 1,
+// on points scaled to around unit size for conditioning
+bool BNO_MagFit::fit(bnoMagCorrection_t &result) {
+	mNewPoints = 0;
+	if (mNumPoints < BNO_MAGFIT_MIN_POINTS) {
+		return false;
+	}
+
+	double scale = 0.0;
+	for (int i = 0; i < mNumPoints; ++i) {
+		scale += sqrt(mPoints[i][0] * mPoints[i][0] + mPoints[i][1] * mPoints[i][1] + mPoints[i][2] * mPoints[i][2]);
+	}
+	scale /= mNumPoints;
+	if (scale <= 0.0) {
+		return false;
+	}
+
+	double ata[9][9];
+	double atb[9];
+	memset(ata, 0, sizeof(ata));
+	memset(atb, 0, sizeof(atb));
+	for (int i = 0; i < mNumPoints; ++i) {
+		double x = mPoints[i][0] / scale, y = mPoints[i][1] / scale, z = mPoints[i][2] / scale;
+		double d[9] = { x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z };
+		for (int r = 0; r < 9; ++r) {
+			for (int c = r; c < 9; ++c) {
+				ata[r][c] += d[r] * d[c];
+			}
+			atb[r] += d[r];
+		}
+	}
+	for (int r = 0; r < 9; ++r) {
+		for (int c = 0; c < r; ++c) {
+			ata[r][c] = ata[c][r];
+		}
+	}
+	if (!solve(ata, atb, 9)) {
+		return false;
+	}
+
+	const double *p = atb;
+	double m[3][3] = {
+		{ p[0], p[3], p[4] },
+		{ p[3], p[1], p[5] },
+		{ p[4], p[5], p[2] }
+	};
+	double mInv[3][3];
+	double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+		- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+		+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	if (fabs(det) < 1e-12) {
+		return false;
+	}
+	mInv[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+	mInv[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+	mInv[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+	mInv[1][0] = mInv[0][1];
+	mInv[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+	mInv[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+	mInv[2][0] = mInv[0][2];
+	mInv[2][1] = mInv[1][2];
+	mInv[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+
+	// center = -M^-1 b, and (q - center)^T M (q - center) = 1 + b^T M^-1 b
+	const double b[3] = { p[6], p[7], p[8] };
+	double center[3];
+	double k = 1.0;
+	for (int i = 0; i < 3; ++i) {
+		center[i] = -(mInv[i][0] * b[0] + mInv[i][1] * b[1] + mInv[i][2] * b[2]);
+		k += b[i] * -center[i];
+	}
+	if (k <= 0.0) {
+		return false;
+	}
+
+	double e[3], v[3][3];
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			m[i][j] /= k;
+		}
+	}
+	eigenSymmetric3(m, e, v);
+	if (e[0] <= 0.0 || e[1] <= 0.0 || e[2] <= 0.0) {
+		return false; // not an ellipsoid
+	}
+
+	// Map onto a sphere with the geometric mean radius, which keeps the
+	// field strength: matrix = r * sqrt(M / k)
+	double radius = pow(e[0] * e[1] * e[2], -1.0 / 6.0);
+	// Strongly flattened clouds mean the sensor hasn't been rotated enough
+	for (int i = 0; i < 3; ++i) {
+		double axis = 1.0 / sqrt(e[i]);
+		if (axis < 0.5 * radius || axis > 2.0 * radius) {
+			return false;
+		}
+	}
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			double sum = 0.0;
+			for (int n = 0; n < 3; ++n) {
+				sum += v[i][n] * sqrt(e[n]) * v[j][n];
+			}
+			result.matrix[i * 3 + j] = (float)(radius * sum);
+		}
+		result.offset[i] = (float)(center[i] * scale);
+	}
+	return true;
+}
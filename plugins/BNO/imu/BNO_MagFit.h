@@ -0,0 +1,66 @@
+/*
+  Magnetometer hard/soft-iron calibration
+  ----------------------------------------------------------
+  Keeps a spatially decimated cloud of raw magnetometer samples and fits
+  an ellipsoid to it by least squares. The fit gives a hard-iron offset and
+  a symmetric soft-iron matrix, so that
+
+      corrected = matrix * (raw - offset)
+
+  lies on a sphere with the radius of the local field. Fitting is meant to
+  run on a worker thread; applying the correction is one matrix-vector
+  multiply per frame.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_MAGFIT_H_
+#define BNO_MAGFIT_H_
+
+#include <stdint.h>
+
+typedef struct {
+	float offset[3]; // uT
+	float matrix[9]; // row major
+} bnoMagCorrection_t;
+
+static inline void bnoApplyMagCorrection(const bnoMagCorrection_t &c, const float *in, float *out) {
+	float x = in[0] - c.offset[0];
+	float y = in[1] - c.offset[1];
+	float z = in[2] - c.offset[2];
+	out[0] = c.matrix[0] * x + c.matrix[1] * y + c.matrix[2] * z;
+	out[1] = c.matrix[3] * x + c.matrix[4] * y + c.matrix[5] * z;
+	out[2] = c.matrix[6] * x + c.matrix[7] * y + c.matrix[8] * z;
+}
+
+#define BNO_MAGFIT_MAX_POINTS 400
+#define BNO_MAGFIT_MIN_POINTS 60
+
+class BNO_MagFit {
+public:
+	BNO_MagFit() {};
+
+	void reset();
+	// Add a sample in uT. Samples closer than the minimum distance to a
+	// point already in the cloud are dropped. Returns true if it was kept.
+	bool add(const float *mag);
+	int size() const { return mNumPoints; }
+	// Number of points added since the last fit
+	int newPoints() const { return mNewPoints; }
+
+	// Fit an ellipsoid to the cloud, false if there are too few points
+	// or the result is not a plausible ellipsoid
+	bool fit(bnoMagCorrection_t &result);
+
+	// uT, default 2
+	void setMinDistance(float distance) { mMinDistance = distance; }
+
+private:
+	float mPoints[BNO_MAGFIT_MAX_POINTS][3];
+	int mNumPoints = 0;
+	int mNext = 0; // oldest point, replaced when full
+	int mNewPoints = 0;
+	float mMinDistance = 2.f;
+};
+
+#endif /* BNO_MAGFIT_H_ */
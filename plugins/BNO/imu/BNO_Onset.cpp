@@ -0,0 +1,65 @@
+/*
+  Onset (strike) detection
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Onset.h"
+
+// Time constant of the running mean and deviation, in seconds
+#define BNO_ONSET_TAU 1.f
+// Readings further apart than this restart the detector, in us
+#define BNO_ONSET_MAX_GAP 1000000
+
+void BNO_Onset::reset() {
+	mLastTime = 0;
+	mMean = mDeviation = 0.f;
+	mInOnset = false;
+}
+
+void BNO_Onset::setParameters(float sensitivity, float minimum, uint64_t refractory) {
+	mSensitivity = sensitivity;
+	mMinimum = minimum;
+	mRefractory = refractory;
+}
+
+bool BNO_Onset::add(uint64_t time, float jerk, float accel) {
+	if (mLastTime == 0 || time <= mLastTime || time - mLastTime > BNO_ONSET_MAX_GAP) {
+		mLastTime = time;
+		mLastValue = jerk;
+		mMean = jerk;
+		mDeviation = 0.f;
+		mInOnset = false;
+		return false;
+	}
+
+	float threshold = fmaxf(mMinimum, mMean + mSensitivity * mDeviation);
+	bool onset = false;
+	if (mInOnset) {
+		// the strength is the peak acceleration of the strike
+		mStrength = fmaxf(mStrength, accel);
+		if (jerk < threshold) {
+			mInOnset = false;
+		}
+	} else if (jerk >= threshold && mLastValue < threshold
+			&& (mCount == 0 || time - mOnsetTime >= mRefractory)) {
+		float frac = (threshold - mLastValue) / (jerk - mLastValue);
+		mOnsetTime = mLastTime + (uint64_t)(frac * (time - mLastTime));
+		mStrength = accel;
+		mCount++;
+		mInOnset = true;
+		onset = true;
+	}
+
+	// Onsets don't raise the threshold for the next ones
+	if (!mInOnset) {
+		float a = 1.f - expf(-(time - mLastTime) * 1e-6f / BNO_ONSET_TAU);
+		mMean += a * (jerk - mMean);
+		mDeviation += a * (fabsf(jerk - mMean) - mDeviation);
+	}
+
+	mLastTime = time;
+	mLastValue = jerk;
+	return onset;
+}
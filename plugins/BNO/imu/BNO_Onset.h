@@ -0,0 +1,56 @@
+/*
+  Onset (strike) detection
+  ----------------------------------------------------------
+  Detects strikes on the reader thread from the jerk of the linear
+  acceleration, so a trigger doesn't wait for the control rate output to
+  be polled. The threshold follows the recent level of the signal: it is
+  the running mean plus a multiple of the running mean absolute deviation,
+  never below a fixed minimum. After an onset no new onset is detected
+  for the refractory period.
+
+  The onset time is interpolated between the two readings around the
+  threshold crossing, so it is more precise than the sensor rate.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_ONSET_H_
+#define BNO_ONSET_H_
+
+#include <stdint.h>
+
+class BNO_Onset {
+public:
+	BNO_Onset() {};
+
+	void reset();
+
+	// A new reading: time in microseconds, jerk in m/s^3 and linear
+	// acceleration magnitude in m/s^2. Returns true on an onset.
+	bool add(uint64_t time, float jerk, float accel);
+
+	// Last onset
+	uint64_t time() const { return mOnsetTime; }
+	float strength() const { return mStrength; }
+	uint32_t count() const { return mCount; }
+
+	// threshold = mean + sensitivity * deviation, at least minimum (m/s^3);
+	// refractory period in microseconds. Defaults 4, 50 and 80 ms.
+	void setParameters(float sensitivity, float minimum, uint64_t refractory);
+
+private:
+	uint64_t mLastTime = 0;
+	float mLastValue = 0.f;
+	float mMean = 0.f, mDeviation = 0.f;
+
+	uint64_t mOnsetTime = 0;
+	float mStrength = 0.f;
+	uint32_t mCount = 0;
+	bool mInOnset = false; // above the threshold, waiting for the peak
+
+	float mSensitivity = 4.f;
+	float mMinimum = 50.f;
+	uint64_t mRefractory = 80000;
+};
+
+#endif /* BNO_ONSET_H_ */
@@ -0,0 +1,77 @@
+/*
+  Platform
+  ----------------------------------------------------------
+  On Bela (built with BELA defined) rt_printf, Bela_stopRequested and the
+  I2c base class come from the Bela core. Anywhere else they are replaced
+  by plain Linux equivalents: printf, no stop request, and an I2c class on
+  /dev/i2c-<bus>. That is enough to run the plugin with BNO_REPLAY on any
+  Linux box, or with a BNO055 on another board's I2C bus.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_PLATFORM_H_
+#define BNO_PLATFORM_H_
+
+#ifdef BELA
+
+#include "Bela.h"
+#include "I2c.h"
+
+#else
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define rt_printf printf
+
+static inline int Bela_stopRequested() { return 0; }
+
+typedef unsigned char i2c_char_t;
+
+// The part of Bela's I2c class the driver uses
+class I2c {
+protected:
+	int i2C_bus = -1;
+	int i2C_address = 0;
+	int i2C_file = -1;
+
+public:
+	// 0 on success, like Bela's
+	int initI2C_RW(int bus, int address, int)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/dev/i2c-%d", bus);
+		i2C_bus = bus;
+		i2C_address = address;
+		i2C_file = open(name, O_RDWR);
+		if (i2C_file < 0) {
+			return 1;
+		}
+		if (ioctl(i2C_file, I2C_SLAVE, address) < 0) {
+			closeI2C();
+			return 2;
+		}
+		return 0;
+	}
+
+	int closeI2C()
+	{
+		if (i2C_file >= 0) {
+			close(i2C_file);
+			i2C_file = -1;
+		}
+		return 0;
+	}
+
+	virtual int readI2C() = 0;
+	virtual ~I2c() { closeI2C(); }
+};
+
+#endif /* BELA */
+
+#endif /* BNO_PLATFORM_H_ */
@@ -0,0 +1,71 @@
+/*
+  Relative orientation of two sensors
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Relative.h"
+
+void BNO_Relative::addReference(uint64_t time, const bnoQuatf_t &quat) {
+	int last = (mNext + BNO_RELATIVE_HISTORY - 1) % BNO_RELATIVE_HISTORY;
+	if (mCount > 0 && time <= mTimes[last]) {
+		return;
+	}
+	float norm = sqrtf(quat.w * quat.w + quat.x * quat.x + quat.y * quat.y + quat.z * quat.z);
+	if (norm <= 0.f) {
+		return;
+	}
+
+	bnoQuatf_t q = { quat.w / norm, quat.x / norm, quat.y / norm, quat.z / norm };
+	// keep consecutive frames in the same hemisphere, so they interpolate the short way
+	if (mCount > 0) {
+		const bnoQuatf_t &p = mQuats[last];
+		if (p.w * q.w + p.x * q.x + p.y * q.y + p.z * q.z < 0.f) {
+			q.w = -q.w; q.x = -q.x; q.y = -q.y; q.z = -q.z;
+		}
+	}
+	mTimes[mNext] = time;
+	mQuats[mNext] = q;
+	mNext = (mNext + 1) % BNO_RELATIVE_HISTORY;
+	if (mCount < BNO_RELATIVE_HISTORY) {
+		mCount++;
+	}
+}
+
+// Reference orientation at time, from newest to oldest frame
+bnoQuatf_t BNO_Relative::reference(uint64_t time) const {
+	int newer = (mNext + BNO_RELATIVE_HISTORY - 1) % BNO_RELATIVE_HISTORY;
+	if (time >= mTimes[newer]) {
+		return mQuats[newer];
+	}
+	for (int i = 1; i < mCount; ++i) {
+		int older = (newer + BNO_RELATIVE_HISTORY - 1) % BNO_RELATIVE_HISTORY;
+		if (time >= mTimes[older]) {
+			// frames are close together, so a normalized lerp is as good as a slerp
+			float t = (float)(time - mTimes[older]) / (float)(mTimes[newer] - mTimes[older]);
+			const bnoQuatf_t &a = mQuats[older];
+			const bnoQuatf_t &b = mQuats[newer];
+			bnoQuatf_t q = { a.w + t * (b.w - a.w), a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z) };
+			float k = 1.f / sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+			q.w *= k; q.x *= k; q.y *= k; q.z *= k;
+			return q;
+		}
+		newer = older;
+	}
+	return mQuats[newer];
+}
+
+bool BNO_Relative::relative(uint64_t time, bnoQuatf_t &quat) const {
+	if (mCount == 0) {
+		return false;
+	}
+	int last = (mNext + BNO_RELATIVE_HISTORY - 1) % BNO_RELATIVE_HISTORY;
+	if (time > mTimes[last] + mMaxAge) {
+		return false;
+	}
+	bnoQuatf_t ref = reference(time);
+	bnoQuatf_t conj = { ref.w, -ref.x, -ref.y, -ref.z };
+	quat = bnoQuatMul(conj, quat);
+	return true;
+}
@@ -0,0 +1,52 @@
+/*
+  Relative orientation of two sensors
+  ----------------------------------------------------------
+  Keeps a short history of the orientation of a reference sensor (e.g. on
+  the torso) and turns the orientation of another sensor (e.g. on the head)
+  into its orientation relative to the reference,
+
+      relative = conj(reference) * quat
+
+  with the reference taken at the time of the other sensor's frame. The
+  reference is interpolated between the two frames around that time, or
+  the nearest frame is used when it is outside the history.
+
+  Both sensors are read on the same thread, so there is no locking.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_RELATIVE_H_
+#define BNO_RELATIVE_H_
+
+#include <stdint.h>
+#include "BNO_Frame.h"
+
+#define BNO_RELATIVE_HISTORY 8
+
+class BNO_Relative {
+public:
+	BNO_Relative() {};
+
+	void reset() { mCount = 0; }
+	// Add an orientation of the reference sensor, in any scale. Frames that
+	// are not newer than the last one are ignored.
+	void addReference(uint64_t time, const bnoQuatf_t &quat);
+	// Replace quat by its orientation relative to the reference at time.
+	// Returns false, leaving quat alone, until there is a reference.
+	bool relative(uint64_t time, bnoQuatf_t &quat) const;
+
+	// reference older than this is not used, microseconds, default 100 ms
+	void setMaxAge(uint64_t age) { mMaxAge = age; }
+
+private:
+	bnoQuatf_t reference(uint64_t time) const;
+
+	uint64_t mTimes[BNO_RELATIVE_HISTORY];
+	bnoQuatf_t mQuats[BNO_RELATIVE_HISTORY]; // normalized
+	int mNext = 0;
+	int mCount = 0;
+	uint64_t mMaxAge = 100000;
+};
+
+#endif /* BNO_RELATIVE_H_ */
@@ -0,0 +1,97 @@
+/*
+  Ambisonic rotation matrices
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Rotation.h"
+
+void bnoQuatToMatrix(const bnoQuatf_t &q, float *r) {
+	float w = q.w, x = q.x, y = q.y, z = q.z;
+	r[0] = 1.f - 2.f * (y*y + z*z);
+	r[1] = 2.f * (x*y - w*z);
+	r[2] = 2.f * (x*z + w*y);
+	r[3] = 2.f * (x*y + w*z);
+	r[4] = 1.f - 2.f * (x*x + z*z);
+	r[5] = 2.f * (y*z - w*x);
+	r[6] = 2.f * (x*z - w*y);
+	r[7] = 2.f * (y*z + w*x);
+	r[8] = 1.f - 2.f * (x*x + y*y);
+}
+
+// Element (m, n) of the block of order l, with m and n in -l..l
+static inline float element(const float *matrix, int l, int m, int n) {
+	return matrix[bnoHoaBlockOffset(l) + (m + l) * (2 * l + 1) + (n + l)];
+}
+
+static float P(const float *matrix, int i, int a, int b, int l) {
+	if (b == l) {
+		return element(matrix, 1, i, 1) * element(matrix, l - 1, a, l - 1)
+			- element(matrix, 1, i, -1) * element(matrix, l - 1, a, -l + 1);
+	} else if (b == -l) {
+		return element(matrix, 1, i, 1) * element(matrix, l - 1, a, -l + 1)
+			+ element(matrix, 1, i, -1) * element(matrix, l - 1, a, l - 1);
+	}
+	return element(matrix, 1, i, 0) * element(matrix, l - 1, a, b);
+}
+
+static float U(const float *matrix, int m, int n, int l) {
+	return P(matrix, 0, m, n, l);
+}
+
+static float V(const float *matrix, int m, int n, int l) {
+	if (m == 0) {
+		return P(matrix, 1, 1, n, l) + P(matrix, -1, -1, n, l);
+	} else if (m > 0) {
+		return m == 1
+			? sqrtf(2.f) * P(matrix, 1, 0, n, l)
+			: P(matrix, 1, m - 1, n, l) - P(matrix, -1, -m + 1, n, l);
+	}
+	return m == -1
+		? sqrtf(2.f) * P(matrix, -1, 0, n, l)
+		: P(matrix, 1, m + 1, n, l) + P(matrix, -1, -m - 1, n, l);
+}
+
+static float W(const float *matrix, int m, int n, int l) {
+	if (m > 0) {
+		return P(matrix, 1, m + 1, n, l) + P(matrix, -1, -m - 1, n, l);
+	}
+	return P(matrix, 1, m - 1, n, l) - P(matrix, -1, -m + 1, n, l);
+}
+
+void bnoHoaRotation(const float *r, int order, float *matrix) {
+	// Order 1 is the rotation itself, with the axes in ACN order (y, z, x)
+	static const int axis[3] = { 1, 2, 0 };
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			matrix[i * 3 + j] = r[axis[i] * 3 + axis[j]];
+		}
+	}
+
+	for (int l = 2; l <= order; ++l) {
+		float *block = matrix + bnoHoaBlockOffset(l);
+		for (int m = -l; m <= l; ++m) {
+			int am = m < 0 ? -m : m;
+			for (int n = -l; n <= l; ++n) {
+				float d = (m == 0) ? 1.f : 0.f;
+				float denom = (n == l || n == -l) ? 2.f * l * (2.f * l - 1.f) : (float)((l + n) * (l - n));
+				float u = sqrtf((l + m) * (l - m) / denom);
+				float v = 0.5f * sqrtf((1.f + d) * (l + am - 1) * (l + am) / denom) * (1.f - 2.f * d);
+				float w = -0.5f * sqrtf((l - am - 1) * (l - am) / denom) * (1.f - d);
+
+				float value = 0.f;
+				if (u != 0.f) {
+					value += u * U(matrix, m, n, l);
+				}
+				if (v != 0.f) {
+					value += v * V(matrix, m, n, l);
+				}
+				if (w != 0.f) {
+					value += w * W(matrix, m, n, l);
+				}
+				block[(m + l) * (2 * l + 1) + (n + l)] = value;
+			}
+		}
+	}
+}
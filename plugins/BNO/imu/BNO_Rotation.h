@@ -0,0 +1,47 @@
+/*
+  Ambisonic rotation matrices
+  ----------------------------------------------------------
+  Rotation matrices for real spherical harmonics in ACN order, built from
+  a 3x3 rotation with the recursion of Ivanic and Ruedenberg (J. Phys.
+  Chem. 1996, with the 1998 corrections). Each order l is rotated by its
+  own (2l+1) x (2l+1) block, order 0 is unchanged. The blocks are the same
+  for SN3D and N3D normalisation, but not for FuMa channel order.
+
+  The blocks of orders 1 to 3 are packed one after the other, row major,
+  so that Y(R d) = M Y(d) for a direction d.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_ROTATION_H_
+#define BNO_ROTATION_H_
+
+#include "BNO_Frame.h"
+
+#define BNO_HOA_MAX_ORDER 3
+// 3x3 + 5x5 + 7x7
+#define BNO_HOA_MATRIX_SIZE 83
+
+// Number of channels of an ambisonic signal of order
+static inline int bnoHoaChannels(int order) {
+	return (order + 1) * (order + 1);
+}
+
+// Number of values in the packed blocks of orders 1 to order
+static inline int bnoHoaMatrixSize(int order) {
+	static const int sizes[BNO_HOA_MAX_ORDER + 1] = { 0, 9, 34, 83 };
+	return sizes[order];
+}
+
+// Offset of the block of order l in a packed matrix
+static inline int bnoHoaBlockOffset(int l) {
+	return bnoHoaMatrixSize(l - 1);
+}
+
+// Row major 3x3 rotation of a unit quaternion, v' = R v
+void bnoQuatToMatrix(const bnoQuatf_t &q, float *r);
+
+// Packed blocks of orders 1 to order for the rotation r
+void bnoHoaRotation(const float *r, int order, float *matrix);
+
+#endif /* BNO_ROTATION_H_ */
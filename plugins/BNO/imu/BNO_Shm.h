@@ -0,0 +1,140 @@
+/*
+  Shared memory frame ring
+  ----------------------------------------------------------
+  With BNO_SHM set, the BNO service publishes every frame to a POSIX
+  shared memory object, so other processes on the same board (Pd, a
+  visualiser) get the sensor data without opening the I2C device. This
+  header is all a consumer needs, in C or C++:
+
+      const bnoShm_t *shm = bnoShmOpen(BNO_SHM_NAME);
+      bnoShmFrame_t frame;
+      if (shm && bnoShmLatest(shm, &frame) == 0) {
+          printf("%f\n", frame.quat[0]);
+      }
+      bnoShmClose(shm);
+
+  Each slot is a seqlock: its sequence number is odd while the slot is
+  written, and a copy is only valid if the number didn't change while
+  copying. The header count is the number of frames written so far,
+  wrapping at 2^32, and is incremented after the slot is written. The
+  last BNO_SHM_SLOTS - 1 frames can be read; the oldest slot may already
+  be in use for the next frame.
+
+  Link with -lrt on older glibc (before 2.17), for shm_open.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_SHM_H_
+#define BNO_SHM_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BNO_SHM_NAME "/bno055"
+#define BNO_SHM_MAGIC 0x314f4e42 /* "BNO1" */
+#define BNO_SHM_VERSION 1
+#define BNO_SHM_SLOTS 64
+
+/* Values in the same units as the BNO UGen */
+typedef struct {
+	uint64_t time;            /* microseconds, CLOCK_MONOTONIC */
+	float accel[3];           /* m/s^2 */
+	float gyro[3];            /* dps */
+	float mag[3];             /* uT */
+	float quat[4];            /* calibrated orientation, w x y z */
+	float features[5];        /* angular speed, linear acceleration, jerk, tilt, activity */
+	float onsetStrength;      /* m/s^2 */
+	uint32_t onsetCount;      /* incremented on each onset */
+	uint64_t onsetTime;       /* microseconds, CLOCK_MONOTONIC */
+	uint8_t interruptCounts[4]; /* any motion, no motion, high-g, high rate */
+	uint8_t calib;            /* CALIB_STAT register */
+	uint8_t pad[3];
+} bnoShmFrame_t;
+
+typedef struct {
+	uint32_t seq;
+	uint32_t pad;
+	bnoShmFrame_t frame;
+} bnoShmSlot_t;
+
+typedef struct {
+	uint32_t magic;   /* written last, once the ring is ready */
+	uint32_t version;
+	uint32_t slots;
+	uint32_t count;
+	bnoShmSlot_t slot[BNO_SHM_SLOTS];
+} bnoShm_t;
+
+/* Map the ring read-only, NULL if no server publishes under name */
+static inline const bnoShm_t *bnoShmOpen(const char *name) {
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	void *p = mmap(NULL, sizeof(bnoShm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	const bnoShm_t *shm = (const bnoShm_t *)p;
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != BNO_SHM_MAGIC
+			|| shm->version != BNO_SHM_VERSION || shm->slots != BNO_SHM_SLOTS) {
+		munmap(p, sizeof(bnoShm_t));
+		return NULL;
+	}
+	return shm;
+}
+
+static inline void bnoShmClose(const bnoShm_t *shm) {
+	if (shm != NULL) {
+		munmap((void *)shm, sizeof(bnoShm_t));
+	}
+}
+
+/* Number of frames published so far */
+static inline uint32_t bnoShmCount(const bnoShm_t *shm) {
+	return __atomic_load_n(&shm->count, __ATOMIC_ACQUIRE);
+}
+
+/* Frame index is published and its slot not reused, given count. Nothing
+   is while count is 0, so the zeroed slots of a new ring are never read
+   (nor, for a moment, the frames when count wraps to 0). */
+static inline int bnoShmAvailable(uint32_t count, uint32_t index) {
+	return count != 0 && count - index - 1 < BNO_SHM_SLOTS - 1;
+}
+
+/* Copy frame number index. Returns 0 on success, -1 if the frame isn't
+   published yet, has been overwritten or is being written. */
+static inline int bnoShmRead(const bnoShm_t *shm, uint32_t index, bnoShmFrame_t *frame) {
+	if (!bnoShmAvailable(bnoShmCount(shm), index)) {
+		return -1;
+	}
+	const bnoShmSlot_t *slot = &shm->slot[index % BNO_SHM_SLOTS];
+	uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1) {
+		return -1;
+	}
+	memcpy(frame, &slot->frame, sizeof(bnoShmFrame_t));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+		return -1;
+	}
+	/* the slot may have been reused for a newer frame in the meantime */
+	return bnoShmAvailable(bnoShmCount(shm), index) ? 0 : -1;
+}
+
+/* Copy the newest frame, 0 on success, -1 if none is published yet */
+static inline int bnoShmLatest(const bnoShm_t *shm, bnoShmFrame_t *frame) {
+	for (int attempt = 0; attempt < 4; ++attempt) {
+		if (bnoShmRead(shm, bnoShmCount(shm) - 1, frame) == 0) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif /* BNO_SHM_H_ */
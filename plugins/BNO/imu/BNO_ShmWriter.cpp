@@ -0,0 +1,79 @@
+/*
+  Shared memory frame ring, writer side
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include "BNO_ShmWriter.h"
+
+bool BNO_ShmWriter::open(const char *name) {
+	close();
+	snprintf(mName, sizeof(mName), "%s", name);
+
+	// readers map it read-only, so only the owner can write
+	int fd = shm_open(mName, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, sizeof(bnoShm_t)) != 0) {
+		::close(fd);
+		shm_unlink(mName);
+		return false;
+	}
+	void *p = mmap(NULL, sizeof(bnoShm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(mName);
+		return false;
+	}
+
+	mShm = (bnoShm_t *)p;
+	// readers check the magic, so it is cleared while the ring is set up
+	__atomic_store_n(&mShm->magic, 0, __ATOMIC_RELAXED);
+	memset(mShm->slot, 0, sizeof(mShm->slot));
+	mShm->version = BNO_SHM_VERSION;
+	mShm->slots = BNO_SHM_SLOTS;
+	__atomic_store_n(&mShm->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&mShm->magic, BNO_SHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+void BNO_ShmWriter::close() {
+	if (mShm == nullptr) {
+		return;
+	}
+	__atomic_store_n(&mShm->magic, 0, __ATOMIC_RELEASE);
+	munmap(mShm, sizeof(bnoShm_t));
+	shm_unlink(mName);
+	mShm = nullptr;
+}
+
+void BNO_ShmWriter::write(const bnoFrame_t &frame) {
+	if (mShm == nullptr) {
+		return;
+	}
+	uint32_t count = __atomic_load_n(&mShm->count, __ATOMIC_RELAXED);
+	bnoShmSlot_t &slot = mShm->slot[count % BNO_SHM_SLOTS];
+
+	uint32_t seq = __atomic_load_n(&slot.seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	bnoShmFrame_t &out = slot.frame;
+	out.time = frame.time;
+	bnoScaleValues(frame.accel, out.accel, 3, BNO_ACCEL);
+	bnoScaleValues(frame.gyro, out.gyro, 3, BNO_GYRO);
+	bnoScaleValues(frame.mag, out.mag, 3, BNO_MAG);
+	bnoScaleValues(frame.quat, out.quat, 4, BNO_QUAT);
+	memcpy(out.features, frame.features, sizeof(out.features));
+	out.onsetStrength = frame.onsetStrength;
+	out.onsetCount = frame.onsetCount;
+	out.onsetTime = frame.onsetTime;
+	memcpy(out.interruptCounts, frame.interruptCounts, sizeof(out.interruptCounts));
+	out.calib = frame.calib;
+
+	__atomic_store_n(&slot.seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&mShm->count, count + 1, __ATOMIC_RELEASE);
+}
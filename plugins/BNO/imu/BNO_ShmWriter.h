@@ -0,0 +1,34 @@
+/*
+  Shared memory frame ring, writer side
+  ----------------------------------------------------------
+  Creates the shared memory object described in BNO_Shm.h and publishes
+  frames to it, scaled to float. Only the reader thread writes.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_SHMWRITER_H_
+#define BNO_SHMWRITER_H_
+
+#include "BNO_Frame.h"
+#include "BNO_Shm.h"
+
+class BNO_ShmWriter {
+public:
+	BNO_ShmWriter() {};
+	~BNO_ShmWriter() { close(); }
+
+	// Create or replace the object name, false on failure
+	bool open(const char *name);
+	// Unmap and remove the object
+	void close();
+	bool isOpen() const { return mShm != nullptr; }
+
+	void write(const bnoFrame_t &frame);
+
+private:
+	bnoShm_t *mShm = nullptr;
+	char mName[64];
+};
+
+#endif /* BNO_SHMWRITER_H_ */
@@ -0,0 +1,136 @@
+/*
+  Recording and replay of raw BNO055 sensor streams
+
+  Johannes Burström 2021
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BNO_Stream.h"
+
+BNO_Recorder::~BNO_Recorder() {
+	close();
+}
+
+bool BNO_Recorder::open(const char *path) {
+	close();
+	mFile = fopen(path, "wb");
+	if (mFile == NULL) {
+		return false;
+	}
+	bnoStreamHeader_t header;
+	memcpy(header.magic, BNO_STREAM_MAGIC, 4);
+	header.version = BNO_STREAM_VERSION;
+	header.frameSize = sizeof(bnoRawFrame_t);
+	header.firstReg = BNO_FRAME_FIRST_REG;
+	if (fwrite(&header, sizeof(header), 1, mFile) != 1) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void BNO_Recorder::close() {
+	if (mFile) {
+		fclose(mFile);
+		mFile = nullptr;
+	}
+}
+
+void BNO_Recorder::write(const bnoRawFrame_t &frame) {
+	if (mFile) {
+		fwrite(&frame, sizeof(bnoRawFrame_t), 1, mFile);
+	}
+}
+
+
+BNO_Replay::~BNO_Replay() {
+	close();
+}
+
+bool BNO_Replay::open(const char *path) {
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(bnoStreamHeader_t)) {
+		::close(fd);
+		return false;
+	}
+	mMapSize = st.st_size;
+	mMap = mmap(NULL, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mMap == MAP_FAILED) {
+		mMap = nullptr;
+		return false;
+	}
+
+	const bnoStreamHeader_t *header = (const bnoStreamHeader_t *)mMap;
+	if (memcmp(header->magic, BNO_STREAM_MAGIC, 4) != 0
+		|| header->version != BNO_STREAM_VERSION
+		|| header->frameSize != sizeof(bnoRawFrame_t)
+		|| header->firstReg != BNO_FRAME_FIRST_REG) {
+		close();
+		return false;
+	}
+
+	mFrames = (const bnoRawFrame_t *)((const char *)mMap + sizeof(bnoStreamHeader_t));
+	mNumFrames = (mMapSize - sizeof(bnoStreamHeader_t)) / sizeof(bnoRawFrame_t);
+	if (mNumFrames == 0) {
+		close();
+		return false;
+	}
+	madvise(mMap, mMapSize, MADV_SEQUENTIAL);
+	mPos = 0;
+	mStartClock = 0;
+	return true;
+}
+
+void BNO_Replay::close() {
+	if (mMap) {
+		munmap(mMap, mMapSize);
+	}
+	mMap = nullptr;
+	mMapSize = 0;
+	mFrames = nullptr;
+	mNumFrames = 0;
+	mPos = 0;
+}
+
+void BNO_Replay::setSpeed(float speed) {
+	mSpeed = speed > 0.f ? speed : 1.f;
+}
+
+bool BNO_Replay::readFrame(bnoRawFrame_t &frame) {
+	if (mFrames == nullptr) {
+		return false;
+	}
+	if (mPos >= mNumFrames) {
+		if (!mLoop) {
+			return false;
+		}
+		mPos = 0;
+		mStartClock = 0;
+	}
+
+	uint64_t now = bnoTimeUs();
+	if (mStartClock == 0) {
+		mStartClock = now;
+	}
+
+	const bnoRawFrame_t &src = mFrames[mPos++];
+	uint64_t due = mStartClock + (uint64_t)((src.time - mFrames[0].time) / mSpeed);
+	if (due > now) {
+		usleep(due - now);
+	}
+
+	frame = src;
+	frame.time = due;
+	return true;
+}
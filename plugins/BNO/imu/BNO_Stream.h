@@ -0,0 +1,65 @@
+/*
+  Recording and replay of raw BNO055 sensor streams
+  ----------------------------------------------------------
+  A stream file is a bnoStreamHeader_t followed by bnoRawFrame_t records,
+  as read from the chip. Replaying a file feeds the frames through the same
+  decode/calibrate/publish pipeline as the I2C device, keeping the original
+  timing (optionally sped up, optionally looped).
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_STREAM_H_
+#define BNO_STREAM_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include "SC_BNO055.h"
+
+#define BNO_STREAM_MAGIC "BNOS"
+#define BNO_STREAM_VERSION 1
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t frameSize; // sizeof(bnoRawFrame_t)
+	uint32_t firstReg;  // register of data[0]
+} bnoStreamHeader_t;
+
+class BNO_Recorder {
+public:
+	BNO_Recorder() {};
+	~BNO_Recorder();
+	bool open(const char *path);
+	void close();
+	void write(const bnoRawFrame_t &frame);
+
+private:
+	FILE *mFile = nullptr;
+};
+
+class BNO_Replay {
+public:
+	BNO_Replay() {};
+	~BNO_Replay();
+	bool open(const char *path);
+	void close();
+	void setSpeed(float speed);
+	void setLoop(bool loop) { mLoop = loop; }
+	// Blocks until the next frame is due, returns false at end of stream
+	bool readFrame(bnoRawFrame_t &frame);
+	size_t numFrames() const { return mNumFrames; }
+
+private:
+	void *mMap = nullptr;
+	size_t mMapSize = 0;
+	const bnoRawFrame_t *mFrames = nullptr;
+	size_t mNumFrames = 0;
+	size_t mPos = 0;
+
+	float mSpeed = 1.f;
+	bool mLoop = false;
+	uint64_t mStartClock = 0; // wall clock at first frame of current pass
+};
+
+#endif /* BNO_STREAM_H_ */
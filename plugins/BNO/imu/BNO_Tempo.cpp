@@ -0,0 +1,140 @@
+/*
+  Periodicity and tempo of motion
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Tempo.h"
+
+// Below this RMS (m/s^2) there is no motion to find a tempo in
+#define BNO_TEMPO_MIN_RMS 0.2f
+// Multiples of the period correlate about as well as the period itself, so
+// the shortest lag with a peak this close to the highest one is taken
+#define BNO_TEMPO_PEAK_RATIO 0.9f
+
+BNO_Tempo::BNO_Tempo() : mFFT(2 * BNO_TEMPO_WINDOW) {
+	setRange(40.f, 240.f);
+	reset();
+}
+
+void BNO_Tempo::reset() {
+	mPos = 0;
+	mCount = 0;
+	mSinceEstimate = 0;
+	mBpm = mConfidence = mPhase = 0.f;
+}
+
+void BNO_Tempo::setRange(float minBpm, float maxBpm) {
+	mMinLag = (int)(60.f * BNO_TEMPO_RATE / maxBpm);
+	mMaxLag = (int)ceilf(60.f * BNO_TEMPO_RATE / minBpm);
+	// at least two periods in the window, and room for the interpolation
+	if (mMinLag < 2) {
+		mMinLag = 2;
+	}
+	if (mMaxLag > BNO_TEMPO_WINDOW / 2) {
+		mMaxLag = BNO_TEMPO_WINDOW / 2;
+	}
+}
+
+bool BNO_Tempo::add(float value) {
+	mWindow[mPos] = value;
+	mPos = (mPos + 1) % BNO_TEMPO_WINDOW;
+	if (mCount < BNO_TEMPO_WINDOW) {
+		mCount++;
+	}
+	if (++mSinceEstimate < BNO_TEMPO_HOP || mCount < BNO_TEMPO_WINDOW) {
+		return false;
+	}
+	mSinceEstimate = 0;
+	analyse();
+	return true;
+}
+
+// Autocorrelation at lag, unbiased and normalized, once analyse() has
+// left it in mRe
+float BNO_Tempo::normalized(int lag, float energy) const {
+	const int n = BNO_TEMPO_WINDOW;
+	return mRe[lag] * n / ((n - lag) * energy);
+}
+
+bool BNO_Tempo::isPeak(int lag, float energy) const {
+	float value = normalized(lag, energy);
+	return value > normalized(lag - 1, energy) && value >= normalized(lag + 1, energy);
+}
+
+void BNO_Tempo::analyse() {
+	const int n = BNO_TEMPO_WINDOW;
+	const int size = mFFT.size();
+
+	// oldest sample first, without the mean, zero padded
+	float mean = 0.f;
+	for (int i = 0; i < n; ++i) {
+		mean += mWindow[i];
+	}
+	mean /= n;
+	for (int i = 0; i < n; ++i) {
+		mSignal[i] = mWindow[(mPos + i) % n] - mean;
+	}
+	for (int i = n; i < size; ++i) {
+		mSignal[i] = 0.f;
+	}
+
+	// The power spectrum is real and even, so its inverse transform is the
+	// real part of its forward transform
+	mFFT.forward(mSignal, mRe, mIm);
+	for (int k = 0; k <= size / 2; ++k) {
+		float power = mRe[k] * mRe[k] + mIm[k] * mIm[k];
+		mSignal[k] = power;
+		if (k > 0 && k < size / 2) {
+			mSignal[size - k] = power;
+		}
+	}
+	mFFT.forward(mSignal, mRe, mIm);
+	// mRe[lag] is now size times the autocorrelation
+
+	float energy = mRe[0];
+	if (energy <= (float)size * n * BNO_TEMPO_MIN_RMS * BNO_TEMPO_MIN_RMS) {
+		mConfidence = 0.f;
+		return;
+	}
+
+	// unbiased and normalized, 1 at lag 0
+	float highest = 0.f;
+	for (int lag = mMinLag; lag <= mMaxLag; ++lag) {
+		if (isPeak(lag, energy) && normalized(lag, energy) > highest) {
+			highest = normalized(lag, energy);
+		}
+	}
+	int best = -1;
+	float bestValue = 0.f;
+	for (int lag = mMinLag; lag <= mMaxLag && best < 0; ++lag) {
+		if (isPeak(lag, energy) && normalized(lag, energy) >= BNO_TEMPO_PEAK_RATIO * highest) {
+			best = lag;
+			bestValue = normalized(lag, energy);
+		}
+	}
+	if (best < 0 || highest <= 0.f) {
+		mConfidence = 0.f;
+		return;
+	}
+
+	float a = normalized(best - 1, energy);
+	float c = normalized(best + 1, energy);
+	float curvature = a - 2.f * bestValue + c;
+	float offset = curvature < 0.f ? 0.5f * (a - c) / curvature : 0.f;
+	float period = best + offset; // samples
+
+	mBpm = 60.f * BNO_TEMPO_RATE / period;
+	mConfidence = fminf(bestValue, 1.f);
+
+	// x ~ A cos(w i + theta), phase of the newest sample
+	const float w = 2.f * (float)M_PI / period;
+	float re = 0.f, im = 0.f;
+	for (int i = 0; i < n; ++i) {
+		re += mWindow[(mPos + i) % n] * cosf(w * i);
+		im -= mWindow[(mPos + i) % n] * sinf(w * i);
+	}
+	float phase = (w * (n - 1) + atan2f(im, re)) / (2.f * (float)M_PI);
+	mPhase = phase - floorf(phase);
+}
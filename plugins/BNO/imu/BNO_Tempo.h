@@ -0,0 +1,62 @@
+/*
+  Periodicity and tempo of motion
+  ----------------------------------------------------------
+  Finds the dominant period of a motion signal (the linear acceleration
+  magnitude, see BNO_Service) over a sliding window of a few seconds.
+  Every BNO_TEMPO_HOP samples the autocorrelation of the window is
+  computed with two real FFTs (power spectrum, then its transform), zero
+  padded so it doesn't wrap around. The period is the first peak in the
+  tempo range that is nearly as high as the highest one, since multiples
+  of the period correlate as well. It is refined by parabolic
+  interpolation, and its normalized height is the confidence. The phase is that of the
+  window's component at the period, so 0 is on the peaks of the signal.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_TEMPO_H_
+#define BNO_TEMPO_H_
+
+#include "BNO_FFT.h"
+
+#define BNO_TEMPO_RATE 100   // samples per second
+#define BNO_TEMPO_WINDOW 512 // samples, about 5 seconds
+#define BNO_TEMPO_HOP 25     // samples between estimates
+
+class BNO_Tempo {
+public:
+	BNO_Tempo();
+
+	void reset();
+	// Add a sample, returns true when there is a new estimate
+	bool add(float value);
+
+	// Beats per minute of the last estimate, 0 before the first
+	float bpm() const { return mBpm; }
+	// 0 to 1, 0 when there is no periodic motion
+	float confidence() const { return mConfidence; }
+	// Beat phase at the last sample, 0 to 1
+	float phase() const { return mPhase; }
+
+	// Range of tempos searched, default 40 to 240 bpm
+	void setRange(float minBpm, float maxBpm);
+
+private:
+	void analyse();
+	float normalized(int lag, float energy) const;
+	bool isPeak(int lag, float energy) const;
+
+	BNO_RealFFT mFFT;
+	float mWindow[BNO_TEMPO_WINDOW]; // ring
+	int mPos = 0;
+	int mCount = 0;
+	int mSinceEstimate = 0;
+	int mMinLag, mMaxLag;
+
+	float mSignal[2 * BNO_TEMPO_WINDOW];
+	float mRe[BNO_TEMPO_WINDOW + 1], mIm[BNO_TEMPO_WINDOW + 1];
+
+	float mBpm = 0.f, mConfidence = 0.f, mPhase = 0.f;
+};
+
+#endif /* BNO_TEMPO_H_ */
@@ -0,0 +1,227 @@
+/*
+  Orientation zones
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "BNO_Zones.h"
+
+static imu::Vector<3> direction(float azimuth, float elevation) {
+	return imu::Vector<3>(cos(elevation) * cos(azimuth), cos(elevation) * sin(azimuth), sin(elevation));
+}
+
+static double angle(const imu::Vector<3> &a, const imu::Vector<3> &b) {
+	return acos(fmax(-1.0, fmin(1.0, a.dot(b))));
+}
+
+BNO_Zones::BNO_Zones() {
+	for (int i = 0; i < BNO_MAX_ZONES; ++i) {
+		mZones[i].type = ZONE_NONE;
+	}
+	for (int f = 0; f < 6; ++f) {
+		for (int i = 0; i < BNO_ZONE_GRID; ++i) {
+			for (int j = 0; j < BNO_ZONE_GRID; ++j) {
+				mGrid[f][i][j] = 0;
+			}
+		}
+	}
+}
+
+void BNO_Zones::setCap(int id, float azimuth, float elevation, float radius) {
+	if (id < 0 || id >= BNO_MAX_ZONES) {
+		return;
+	}
+	bnoZone_t &zone = mZones[id];
+	zone.type = ZONE_CAP;
+	zone.center = direction(azimuth, elevation);
+	zone.cosRadius = cos(radius);
+	zone.bound = radius;
+	zone.valid = true;
+	mUsed |= 1u << id;
+	mDirty = true;
+}
+
+void BNO_Zones::addVertex(int id, float azimuth, float elevation) {
+	if (id < 0 || id >= BNO_MAX_ZONES) {
+		return;
+	}
+	bnoZone_t &zone = mZones[id];
+	if (zone.type != ZONE_POLYGON) {
+		zone.type = ZONE_POLYGON;
+		zone.numVertices = 0;
+	}
+	if (zone.numVertices < BNO_ZONE_MAX_VERTICES) {
+		zone.vertices[zone.numVertices++] = direction(azimuth, elevation);
+	}
+	mUsed |= 1u << id;
+	mDirty = true;
+}
+
+void BNO_Zones::clear(int id) {
+	for (int i = 0; i < BNO_MAX_ZONES; ++i) {
+		if (id < 0 || id == i) {
+			mZones[i].type = ZONE_NONE;
+			mUsed &= ~(1u << i);
+		}
+	}
+	mDirty = true;
+}
+
+// Centre, tangent plane and projected vertices of a polygon
+void BNO_Zones::prepare(bnoZone_t &zone) {
+	if (zone.type != ZONE_POLYGON) {
+		return;
+	}
+	zone.valid = false;
+	if (zone.numVertices < 3) {
+		return;
+	}
+
+	imu::Vector<3> c;
+	for (int i = 0; i < zone.numVertices; ++i) {
+		c = c + zone.vertices[i];
+	}
+	if (c.magnitude() < 1e-9) {
+		return;
+	}
+	c.normalize();
+	zone.center = c;
+
+	// any axis not parallel to the centre
+	imu::Vector<3> axis = fabs(c.z()) < 0.9 ? imu::Vector<3>(0, 0, 1) : imu::Vector<3>(1, 0, 0);
+	zone.e1 = axis.cross(c);
+	zone.e1.normalize();
+	zone.e2 = c.cross(zone.e1);
+
+	zone.bound = 0.0;
+	for (int i = 0; i < zone.numVertices; ++i) {
+		const imu::Vector<3> &p = zone.vertices[i];
+		double d = p.dot(c);
+		if (d <= 1e-6) {
+			return; // not within a hemisphere
+		}
+		zone.projected[i][0] = p.dot(zone.e1) / d;
+		zone.projected[i][1] = p.dot(zone.e2) / d;
+		zone.bound = fmax(zone.bound, angle(p, c));
+	}
+	zone.valid = true;
+}
+
+bool BNO_Zones::contains(const bnoZone_t &zone, const imu::Vector<3> &dir) const {
+	if (!zone.valid) {
+		return false;
+	}
+	if (zone.type == ZONE_CAP) {
+		return dir.dot(zone.center) >= zone.cosRadius;
+	}
+
+	double d = dir.dot(zone.center);
+	if (d <= 0.0) {
+		return false;
+	}
+	double x = dir.dot(zone.e1) / d;
+	double y = dir.dot(zone.e2) / d;
+	// crossing number
+	bool inside = false;
+	for (int i = 0, j = zone.numVertices - 1; i < zone.numVertices; j = i++) {
+		const double *a = zone.projected[i];
+		const double *b = zone.projected[j];
+		if ((a[1] > y) != (b[1] > y) && x < (b[0] - a[0]) * (y - a[1]) / (b[1] - a[1]) + a[0]) {
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+// Cube face of the largest component, and the cell of the other two
+void BNO_Zones::cell(const imu::Vector<3> &dir, int &face, int &i, int &j) {
+	double ax = fabs(dir.x()), ay = fabs(dir.y()), az = fabs(dir.z());
+	double u, v;
+	if (ax >= ay && ax >= az) {
+		face = dir.x() > 0 ? 0 : 1;
+		u = dir.y() / ax;
+		v = dir.z() / ax;
+	} else if (ay >= az) {
+		face = dir.y() > 0 ? 2 : 3;
+		u = dir.x() / ay;
+		v = dir.z() / ay;
+	} else {
+		face = dir.z() > 0 ? 4 : 5;
+		u = dir.x() / az;
+		v = dir.y() / az;
+	}
+	i = (int)((u + 1.0) * 0.5 * BNO_ZONE_GRID);
+	j = (int)((v + 1.0) * 0.5 * BNO_ZONE_GRID);
+	i = i < 0 ? 0 : (i >= BNO_ZONE_GRID ? BNO_ZONE_GRID - 1 : i);
+	j = j < 0 ? 0 : (j >= BNO_ZONE_GRID ? BNO_ZONE_GRID - 1 : j);
+}
+
+// Unit direction of face coordinates u, v in [-1, 1]
+imu::Vector<3> BNO_Zones::cellPoint(int face, double u, double v) {
+	double s = (face & 1) ? -1.0 : 1.0;
+	imu::Vector<3> p;
+	switch (face >> 1) {
+	case 0: p = imu::Vector<3>(s, u, v); break;
+	case 1: p = imu::Vector<3>(u, s, v); break;
+	default: p = imu::Vector<3>(u, v, s); break;
+	}
+	p.normalize();
+	return p;
+}
+
+// A zone is listed in every cell that its bounding cap reaches
+void BNO_Zones::rebuild() {
+	for (int z = 0; z < BNO_MAX_ZONES; ++z) {
+		prepare(mZones[z]);
+	}
+	const double step = 2.0 / BNO_ZONE_GRID;
+	for (int f = 0; f < 6; ++f) {
+		for (int i = 0; i < BNO_ZONE_GRID; ++i) {
+			for (int j = 0; j < BNO_ZONE_GRID; ++j) {
+				double u0 = -1.0 + i * step, v0 = -1.0 + j * step;
+				imu::Vector<3> center = cellPoint(f, u0 + 0.5 * step, v0 + 0.5 * step);
+				double radius = 0.0;
+				for (int k = 0; k < 4; ++k) {
+					radius = fmax(radius, angle(center, cellPoint(f, u0 + (k & 1) * step, v0 + (k >> 1) * step)));
+				}
+				uint32_t zones = 0;
+				for (int z = 0; z < BNO_MAX_ZONES; ++z) {
+					const bnoZone_t &zone = mZones[z];
+					if (zone.type != ZONE_NONE && zone.valid && angle(center, zone.center) <= zone.bound + radius) {
+						zones |= 1u << z;
+					}
+				}
+				mGrid[f][i][j] = zones;
+			}
+		}
+	}
+	mDirty = false;
+}
+
+uint32_t BNO_Zones::test(const imu::Vector<3> &dir) {
+	if (mDirty) {
+		rebuild();
+	}
+	int face, i, j;
+	cell(dir, face, i, j);
+	uint32_t candidates = mGrid[face][i][j];
+	uint32_t inside = 0;
+	while (candidates) {
+		int z = __builtin_ctz(candidates);
+		candidates &= candidates - 1;
+		if (contains(mZones[z], dir)) {
+			inside |= 1u << z;
+		}
+	}
+	return inside;
+}
+
+bool BNO_Zones::update(const imu::Vector<3> &dir) {
+	uint32_t inside = test(dir);
+	mEntered = inside & ~mInside;
+	mExited = mInside & ~inside;
+	mInside = inside;
+	mActive = inside ? __builtin_ctz(inside) : -1;
+	return (mEntered | mExited) != 0;
+}
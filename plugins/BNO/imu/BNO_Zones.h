@@ -0,0 +1,83 @@
+/*
+  Orientation zones
+  ----------------------------------------------------------
+  Regions on the sphere of directions, either spherical caps or spherical
+  polygons, tested against the forward direction of the calibrated
+  orientation. A cube map grid over the sphere lists the zones that can
+  contain any direction in each cell, so a test only looks at a cell and
+  the few zones near it, however many zones there are.
+
+  Polygons must lie within a hemisphere. They are tested in the gnomonic
+  projection around their centre, which maps their great circle edges to
+  straight lines, so they don't need to be convex.
+
+  Directions are given as azimuth (radians, counterclockwise from the
+  forward axis x towards y) and elevation (radians, up positive).
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_ZONES_H_
+#define BNO_ZONES_H_
+
+#include <stdint.h>
+#include "imumaths.h"
+
+#define BNO_MAX_ZONES 32
+#define BNO_ZONE_MAX_VERTICES 16
+#define BNO_ZONE_GRID 16 // cells per cube face side
+
+class BNO_Zones {
+public:
+	BNO_Zones();
+
+	void setCap(int id, float azimuth, float elevation, float radius);
+	// Add a vertex to polygon id, in order around the polygon
+	void addVertex(int id, float azimuth, float elevation);
+	// id -1 clears all zones
+	void clear(int id);
+	bool empty() const { return mUsed == 0; }
+
+	// Zones containing a unit direction, bit i for zone i
+	uint32_t test(const imu::Vector<3> &dir);
+
+	// Track a new direction. Returns true if any zone was entered or left.
+	bool update(const imu::Vector<3> &dir);
+	// Lowest zone containing the direction, -1 for none
+	int active() const { return mActive; }
+	// Zones entered and left at the last update
+	uint32_t entered() const { return mEntered; }
+	uint32_t exited() const { return mExited; }
+
+private:
+	enum { ZONE_NONE, ZONE_CAP, ZONE_POLYGON };
+	typedef struct {
+		int type;
+		imu::Vector<3> center;
+		double cosRadius;  // cap
+		double bound;      // angular radius of a cap containing the zone
+		// polygon
+		int numVertices;
+		imu::Vector<3> vertices[BNO_ZONE_MAX_VERTICES];
+		imu::Vector<3> e1, e2; // tangent plane at the centre
+		double projected[BNO_ZONE_MAX_VERTICES][2];
+		bool valid;
+	} bnoZone_t;
+
+	void prepare(bnoZone_t &zone);
+	bool contains(const bnoZone_t &zone, const imu::Vector<3> &dir) const;
+	void rebuild();
+	static void cell(const imu::Vector<3> &dir, int &face, int &i, int &j);
+	static imu::Vector<3> cellPoint(int face, double u, double v);
+
+	bnoZone_t mZones[BNO_MAX_ZONES];
+	uint32_t mUsed = 0;
+	uint32_t mGrid[6][BNO_ZONE_GRID][BNO_ZONE_GRID];
+	bool mDirty = false;
+
+	uint32_t mInside = 0;
+	uint32_t mEntered = 0, mExited = 0;
+	int mActive = -1;
+};
+
+#endif /* BNO_ZONES_H_ */
@@ -39,7 +39,9 @@ The Bela software is distributed under the GNU Lesser General Public License
 
 
 #include "Bela_BNO055.h"
-#include <iostream>
+#include "BNO_Log.h"
+#include <string.h>
+#include <time.h>
 
 /**************************************************************************
 	I2C_BNO055
@@ -50,13 +52,23 @@ I2C_BNO055::I2C_BNO055()
 
 }
 
+static uint64_t monotonicUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
 /**************************************************************************
 	begin
-    Handles initializing the sensor
+    Handles initializing the sensor. If the chip is already running in the
+    requested configuration, the reset is skipped (warm start).
 **************************************************************************/
-boolean I2C_BNO055::begin(uint8_t bus, uint8_t i2caddr) 
+boolean I2C_BNO055::begin(uint8_t bus, uint8_t i2caddr, i2c_bno055_opmode_t mode, boolean usextal)
 {
+  uint64_t start = monotonicUs();
   _i2c_address = i2caddr;
+  _warm_start = false;
 	
 	// begin I2C communication
   	if(initI2C_RW(bus, i2caddr, 0) > 0)
@@ -74,6 +86,14 @@ boolean I2C_BNO055::begin(uint8_t bus, uint8_t i2caddr)
     	}
   	}
 
+  	if (isConfigured(mode, usextal)) {
+  		_mode = mode;
+  		_warm_start = true;
+  		_startup_us = monotonicUs() - start;
+  		rt_printf("BNO055 already configured, warm start\n");
+  		return true;
+  	}
+
   	// switch to config mode (just in case since this is the default) */
   	setMode(OPERATION_MODE_CONFIG);
   	rt_printf("switching to operation mode\n");
@@ -107,15 +127,42 @@ boolean I2C_BNO055::begin(uint8_t bus, uint8_t i2caddr)
   writeRegister(BNO055_AXIS_MAP_SIGN_ADDR, REMAP_SIGN_P2); // P0-P7, Default is P1
   usleep(10);*/
   
-  writeRegister(BNO055_SYS_TRIGGER_ADDR, 0x0);
+  // still in config mode, so the clock source can be selected here
+  // instead of toggling modes again in setExtCrystalUse
+  writeRegister(BNO055_SYS_TRIGGER_ADDR, usextal ? 0x80 : 0x0);
   usleep(10);
   // Set the requested operating mode (see section 3.3) 
-  setMode(OPERATION_MODE_IMUPLUS);
+  setMode(mode);
   usleep(20);
 
+  _startup_us = monotonicUs() - start;
   return true;
 }
 
+/**************************************************************************
+	isConfigured
+    True if the chip is running in mode with the requested clock source,
+    in normal power mode and without errors
+**************************************************************************/
+boolean I2C_BNO055::isConfigured(i2c_bno055_opmode_t mode, boolean usextal)
+{
+  writeRegister(BNO055_PAGE_ID_ADDR, 0);
+
+  if ((readRegister(BNO055_OPR_MODE_ADDR) & 0x0F) != mode)
+    return false;
+  if ((readRegister(BNO055_PWR_MODE_ADDR) & 0x03) != POWER_MODE_NORMAL)
+    return false;
+  if (((readRegister(BNO055_SYS_TRIGGER_ADDR) & 0x80) != 0) != (usextal != 0))
+    return false;
+
+  /* 5 = fusion algorithm running, 6 = running without fusion (section 4.3.58) */
+  uint8_t status = readRegister(BNO055_SYS_STAT_ADDR);
+  if (status != 5 && status != 6)
+    return false;
+
+  return readRegister(BNO055_SYS_ERR_ADDR) == 0;
+}
+
 /**************************************************************************
 	setMode
     Puts the chip in the specified operating mode
@@ -137,6 +184,9 @@ void I2C_BNO055::setExtCrystalUse(boolean usextal)
 {
   i2c_bno055_opmode_t modeback = _mode;
 
+  if (((readRegister(BNO055_SYS_TRIGGER_ADDR) & 0x80) != 0) == (usextal != 0))
+    return;
+
   /* Switch to config mode (just in case since this is the default) */
   setMode(OPERATION_MODE_CONFIG);
   usleep(25);
@@ -228,6 +278,211 @@ void I2C_BNO055::getCalibration(uint8_t* sys, uint8_t* gyro, uint8_t* accel, uin
   }
 }
 
+/**************************************************************************
+	isFullyCalibrated
+    True if all sensors used by the current mode report calibration 3
+**************************************************************************/
+boolean I2C_BNO055::isFullyCalibrated(void)
+{
+  uint8_t system, gyro, accel, mag;
+  getCalibration(&system, &gyro, &accel, &mag);
+
+  switch (_mode) {
+    case OPERATION_MODE_ACCONLY:
+      return (accel == 3);
+    case OPERATION_MODE_MAGONLY:
+      return (mag == 3);
+    case OPERATION_MODE_GYRONLY:
+    case OPERATION_MODE_M4G: /* No magnetometer calibration required. */
+      return (gyro == 3);
+    case OPERATION_MODE_ACCMAG:
+    case OPERATION_MODE_COMPASS:
+      return (accel == 3 && mag == 3);
+    case OPERATION_MODE_ACCGYRO:
+    case OPERATION_MODE_IMUPLUS:
+      return (accel == 3 && gyro == 3);
+    case OPERATION_MODE_MAGGYRO:
+      return (mag == 3 && gyro == 3);
+    default:
+      return (system == 3 && gyro == 3 && accel == 3 && mag == 3);
+  }
+}
+
+/**************************************************************************
+	getSensorOffsets
+    Reads the accel/mag/gyro offsets and radii (22 bytes) in one burst.
+    The registers are only valid in CONFIG mode (section 3.6.4).
+**************************************************************************/
+boolean I2C_BNO055::getSensorOffsets(uint8_t *calibData)
+{
+  i2c_bno055_opmode_t modeback = _mode;
+  setMode(OPERATION_MODE_CONFIG);
+  usleep(25000);
+
+  boolean ok = readLen(ACCEL_OFFSET_X_LSB_ADDR, calibData, NUM_BNO055_OFFSET_REGISTERS);
+
+  setMode(modeback);
+  usleep(20000);
+  return ok;
+}
+
+/**************************************************************************
+	setSensorOffsets
+    Writes back offsets read by getSensorOffsets, in CONFIG mode
+**************************************************************************/
+void I2C_BNO055::setSensorOffsets(const uint8_t *calibData)
+{
+  i2c_bno055_opmode_t modeback = _mode;
+  setMode(OPERATION_MODE_CONFIG);
+  usleep(25000);
+
+  for (int i = 0; i < NUM_BNO055_OFFSET_REGISTERS; ++i) {
+    writeRegister(ACCEL_OFFSET_X_LSB_ADDR + i, calibData[i]);
+  }
+
+  setMode(modeback);
+  usleep(20000);
+}
+
+/**************************************************************************
+	updatePage1
+    Read-modify-write of page 1 registers, in CONFIG mode
+**************************************************************************/
+void I2C_BNO055::updatePage1(const page1_update_t *updates, int count)
+{
+  i2c_bno055_opmode_t modeback = _mode;
+  setMode(OPERATION_MODE_CONFIG);
+  usleep(25000);
+  writeRegister(BNO055_PAGE_ID_ADDR, 1);
+
+  for (int i = 0; i < count; ++i) {
+    uint8_t value = readRegister(updates[i].reg);
+    value = (value & ~updates[i].mask) | (updates[i].value & updates[i].mask);
+    writeRegister(updates[i].reg, value);
+  }
+
+  writeRegister(BNO055_PAGE_ID_ADDR, 0);
+  setMode(modeback);
+  usleep(20000);
+}
+
+/**************************************************************************
+	enableAnyMotion
+    Accelerometer slope interrupt. duration: 0-3, number of samples - 1
+**************************************************************************/
+void I2C_BNO055::enableAnyMotion(uint8_t threshold, uint8_t duration, uint8_t axes)
+{
+  const page1_update_t updates[] = {
+    { BNO055_ACC_AM_THRES_ADDR, 0xFF, threshold },
+    { BNO055_ACC_INT_SETTINGS_ADDR, 0x1F, (uint8_t)(((axes & 0x07) << 2) | (duration & 0x03)) },
+    { BNO055_INT_MSK_ADDR, INTR_ACC_AM, INTR_ACC_AM },
+    { BNO055_INT_EN_ADDR, INTR_ACC_AM, INTR_ACC_AM }
+  };
+  updatePage1(updates, 4);
+}
+
+/**************************************************************************
+	enableNoMotion
+    Accelerometer no motion interrupt. duration: 0-63, see table 4-5.
+    Shares the axis selection with any motion.
+**************************************************************************/
+void I2C_BNO055::enableNoMotion(uint8_t threshold, uint8_t duration, uint8_t axes)
+{
+  const page1_update_t updates[] = {
+    { BNO055_ACC_NM_THRES_ADDR, 0xFF, threshold },
+    { BNO055_ACC_NM_SET_ADDR, 0x7F, (uint8_t)(((duration & 0x3F) << 1) | 0x01) },
+    { BNO055_ACC_INT_SETTINGS_ADDR, 0x1C, (uint8_t)((axes & 0x07) << 2) },
+    { BNO055_INT_MSK_ADDR, INTR_ACC_NM, INTR_ACC_NM },
+    { BNO055_INT_EN_ADDR, INTR_ACC_NM, INTR_ACC_NM }
+  };
+  updatePage1(updates, 5);
+}
+
+/**************************************************************************
+	enableHighG
+    Accelerometer high-g interrupt. duration: (duration + 1) * 2 ms
+**************************************************************************/
+void I2C_BNO055::enableHighG(uint8_t threshold, uint8_t duration, uint8_t axes)
+{
+  const page1_update_t updates[] = {
+    { BNO055_ACC_HG_THRES_ADDR, 0xFF, threshold },
+    { BNO055_ACC_HG_DURATION_ADDR, 0xFF, duration },
+    { BNO055_ACC_INT_SETTINGS_ADDR, 0xE0, (uint8_t)((axes & 0x07) << 5) },
+    { BNO055_INT_MSK_ADDR, INTR_ACC_HIGH_G, INTR_ACC_HIGH_G },
+    { BNO055_INT_EN_ADDR, INTR_ACC_HIGH_G, INTR_ACC_HIGH_G }
+  };
+  updatePage1(updates, 5);
+}
+
+/**************************************************************************
+	enableHighRate
+    Gyroscope high rate interrupt, same threshold (0-31) and duration
+    ((duration + 1) * 2.5 ms) for all axes
+**************************************************************************/
+void I2C_BNO055::enableHighRate(uint8_t threshold, uint8_t duration, uint8_t axes)
+{
+  const page1_update_t updates[] = {
+    { BNO055_GYR_HR_X_SET_ADDR, 0x1F, threshold },
+    { BNO055_GYR_DUR_X_ADDR, 0xFF, duration },
+    { BNO055_GYR_HR_Y_SET_ADDR, 0x1F, threshold },
+    { BNO055_GYR_DUR_Y_ADDR, 0xFF, duration },
+    { BNO055_GYR_HR_Z_SET_ADDR, 0x1F, threshold },
+    { BNO055_GYR_DUR_Z_ADDR, 0xFF, duration },
+    { BNO055_GYR_INT_SETTING_ADDR, 0x38, (uint8_t)((axes & 0x07) << 3) },
+    { BNO055_INT_MSK_ADDR, INTR_GYR_HIGH_RATE, INTR_GYR_HIGH_RATE },
+    { BNO055_INT_EN_ADDR, INTR_GYR_HIGH_RATE, INTR_GYR_HIGH_RATE }
+  };
+  updatePage1(updates, 9);
+}
+
+/**************************************************************************
+	enableGyroAnyMotion
+    Gyroscope slope interrupt. threshold: 0-127, samples: 0-3 for 8-64
+**************************************************************************/
+void I2C_BNO055::enableGyroAnyMotion(uint8_t threshold, uint8_t samples, uint8_t axes)
+{
+  const page1_update_t updates[] = {
+    { BNO055_GYR_AM_THRES_ADDR, 0x7F, threshold },
+    { BNO055_GYR_AM_SET_ADDR, 0x03, samples },
+    { BNO055_GYR_INT_SETTING_ADDR, 0x07, (uint8_t)(axes & 0x07) },
+    { BNO055_INT_MSK_ADDR, INTR_GYRO_AM, INTR_GYRO_AM },
+    { BNO055_INT_EN_ADDR, INTR_GYRO_AM, INTR_GYRO_AM }
+  };
+  updatePage1(updates, 5);
+}
+
+/**************************************************************************
+	disableInterrupts
+    Disable the interrupts in mask (i2c_bno055_intr_t bits)
+**************************************************************************/
+void I2C_BNO055::disableInterrupts(uint8_t mask)
+{
+  const page1_update_t updates[] = {
+    { BNO055_INT_MSK_ADDR, mask, 0 },
+    { BNO055_INT_EN_ADDR, mask, 0 }
+  };
+  updatePage1(updates, 2);
+}
+
+/**************************************************************************
+	getInterruptStatus
+    Interrupts that fired since the last reset (i2c_bno055_intr_t bits)
+**************************************************************************/
+uint8_t I2C_BNO055::getInterruptStatus(void)
+{
+  return readRegister(BNO055_INTR_STAT_ADDR);
+}
+
+/**************************************************************************
+	resetInterrupts
+    Clears the interrupt status and the INT pin, keeping the clock source
+**************************************************************************/
+void I2C_BNO055::resetInterrupts(void)
+{
+  uint8_t trigger = readRegister(BNO055_SYS_TRIGGER_ADDR) & 0x80;
+  writeRegister(BNO055_SYS_TRIGGER_ADDR, trigger | 0x40);
+}
+
 /**************************************************************************
 	readRegister
     Reads from requested register
@@ -260,7 +515,7 @@ uint8_t I2C_BNO055::readRegister(uint8_t reg)
     packets.nmsgs     = 2;
     int t = ioctl(i2C_file, I2C_RDWR, &packets);
     if( t < 0) {
-        rt_printf("Unable to send data from readRegister: %d\n", t);
+        bnoLog(BNO_LOG_I2C_READ, reg, t);
         return 0;
     }
 
@@ -268,6 +523,39 @@ uint8_t I2C_BNO055::readRegister(uint8_t reg)
 }
 
 
+/**************************************************************************
+	readLen
+    Reads len consecutive registers, starting at reg, in one transfer
+**************************************************************************/
+bool I2C_BNO055::readLen(uint8_t reg, uint8_t *buffer, uint8_t len)
+{
+    i2c_char_t outbuf;
+    struct i2c_rdwr_ioctl_data packets;
+    struct i2c_msg messages[2];
+
+    outbuf = reg;
+    messages[0].addr  = _i2c_address;
+    messages[0].flags = 0;
+    messages[0].len   = sizeof(outbuf);
+    messages[0].buf   = &outbuf;
+
+    messages[1].addr  = _i2c_address;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len   = len;
+    messages[1].buf   = buffer;
+
+    packets.msgs      = messages;
+    packets.nmsgs     = 2;
+    int t = ioctl(i2C_file, I2C_RDWR, &packets);
+    if( t < 0) {
+        bnoLog(BNO_LOG_I2C_READ, reg, t);
+        return false;
+    }
+
+    return true;
+}
+
+
 /**************************************************************************
 	writeRegister
     Writes to register
@@ -278,7 +566,7 @@ void I2C_BNO055::writeRegister(uint8_t reg, uint8_t value)
 
 	if(write(i2C_file, buf, 2) != 2)
 	{
-		std::cout << "Failed to write register " << (int)reg << " on BNO055\n";
+		bnoLog(BNO_LOG_I2C_WRITE, reg);
 		return;
 	}
 }
@@ -319,7 +607,7 @@ imu::Quaternion I2C_BNO055::getQuat(void)
 
 /**************************************************************************
 	getVector
-    Get sensor vector reading - currently only works for gravity
+    Get sensor vector reading
 **************************************************************************/
 imu::Vector<3> I2C_BNO055::getVector(i2c_vector_type_t vector_type)
 {
@@ -329,17 +617,13 @@ imu::Vector<3> I2C_BNO055::getVector(i2c_vector_type_t vector_type)
   x = y = z = 0;
 
   /* Read vector data (6 bytes) */
-  
-  uint8_t x_lsb = readRegister(BNO055_GRAVITY_DATA_X_LSB_ADDR);
-  uint8_t x_msb = readRegister(BNO055_GRAVITY_DATA_X_MSB_ADDR);
-  uint8_t y_lsb = readRegister(BNO055_GRAVITY_DATA_Y_LSB_ADDR);
-  uint8_t y_msb = readRegister(BNO055_GRAVITY_DATA_Y_MSB_ADDR);
-  uint8_t z_lsb = readRegister(BNO055_GRAVITY_DATA_Z_LSB_ADDR);
-  uint8_t z_msb = readRegister(BNO055_GRAVITY_DATA_Z_MSB_ADDR);
-
-  x = ((int16_t)x_lsb) | (((int16_t)x_msb) << 8);
-  y = ((int16_t)y_lsb) | (((int16_t)y_msb) << 8);
-  z = ((int16_t)z_lsb) | (((int16_t)z_msb) << 8);
+  uint8_t buffer[6];
+  memset(buffer, 0, 6);
+  readLen((uint8_t)vector_type, buffer, 6);
+
+  x = ((int16_t)buffer[0]) | (((int16_t)buffer[1]) << 8);
+  y = ((int16_t)buffer[2]) | (((int16_t)buffer[3]) << 8);
+  z = ((int16_t)buffer[4]) | (((int16_t)buffer[5]) << 8);
 
   /* Convert the value to an appropriate range (section 3.6.4) */
   /* and assign the value to the Vector type */
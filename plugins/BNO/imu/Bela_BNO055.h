@@ -40,8 +40,7 @@ The Bela software is distributed under the GNU Lesser General Public License
 #ifndef BNO055_H_
 #define BNO055_H_
 
-#include "Bela.h"
-#include "I2c.h"
+#include "BNO_Platform.h"
 #include "imumaths.h"
 //#include "Utilities.h"
 
@@ -51,6 +50,8 @@ typedef bool boolean;
 #define BNO055_ADDRESS_B (0x29)
 #define BNO055_ID        (0xA0)
 
+#define NUM_BNO055_OFFSET_REGISTERS (22)
+
 
 class I2C_BNO055 : public I2c
 {
@@ -263,6 +264,38 @@ typedef enum
       uint8_t  bl_rev;
     } i2c_bno055_rev_info_t;
 
+    typedef enum
+    {
+      /* PAGE1 REGISTER DEFINITION, interrupt configuration */
+      BNO055_INT_MSK_ADDR                                     = 0X0F,
+      BNO055_INT_EN_ADDR                                      = 0X10,
+      BNO055_ACC_AM_THRES_ADDR                                = 0X11,
+      BNO055_ACC_INT_SETTINGS_ADDR                            = 0X12,
+      BNO055_ACC_HG_DURATION_ADDR                             = 0X13,
+      BNO055_ACC_HG_THRES_ADDR                                = 0X14,
+      BNO055_ACC_NM_THRES_ADDR                                = 0X15,
+      BNO055_ACC_NM_SET_ADDR                                  = 0X16,
+      BNO055_GYR_INT_SETTING_ADDR                             = 0X17,
+      BNO055_GYR_HR_X_SET_ADDR                                = 0X18,
+      BNO055_GYR_DUR_X_ADDR                                   = 0X19,
+      BNO055_GYR_HR_Y_SET_ADDR                                = 0X1A,
+      BNO055_GYR_DUR_Y_ADDR                                   = 0X1B,
+      BNO055_GYR_HR_Z_SET_ADDR                                = 0X1C,
+      BNO055_GYR_DUR_Z_ADDR                                   = 0X1D,
+      BNO055_GYR_AM_THRES_ADDR                                = 0X1E,
+      BNO055_GYR_AM_SET_ADDR                                  = 0X1F
+    } i2c_bno055_page1_reg_t;
+
+    typedef enum
+    {
+      /* Interrupt bits of INT_MSK, INT_EN and INTR_STAT */
+      INTR_GYRO_AM                                            = 0X04,
+      INTR_GYR_HIGH_RATE                                      = 0X08,
+      INTR_ACC_HIGH_G                                         = 0X20,
+      INTR_ACC_AM                                             = 0X40,
+      INTR_ACC_NM                                             = 0X80
+    } i2c_bno055_intr_t;
+
     typedef enum
     {
       VECTOR_ACCELEROMETER = BNO055_ACCEL_DATA_X_LSB_ADDR,
@@ -276,22 +309,47 @@ typedef enum
 	// Hardware I2C
 	I2C_BNO055();
 
-	boolean begin(uint8_t bus = 1, uint8_t i2caddr = BNO055_ADDRESS_A);
+	boolean begin(uint8_t bus = 1, uint8_t i2caddr = BNO055_ADDRESS_A,
+	              i2c_bno055_opmode_t mode = OPERATION_MODE_IMUPLUS, boolean usextal = true);
+	boolean isConfigured(i2c_bno055_opmode_t mode, boolean usextal);
+	boolean warmStarted() const { return _warm_start; }
+	uint64_t startupTime() const { return _startup_us; } // microseconds spent in begin
 
 	uint8_t readRegister(uint8_t reg);
+	bool readLen(uint8_t reg, uint8_t *buffer, uint8_t len);
 	void writeRegister(uint8_t reg, uint8_t value);
 	void setMode( i2c_bno055_opmode_t mode );
 	void getSystemStatus(uint8_t *system_status, uint8_t *self_test_result, uint8_t *system_error);
 	void getCalibration(uint8_t* sys, uint8_t* gyro, uint8_t* accel, uint8_t* mag);
 	void setExtCrystalUse    ( boolean usextal );
+	boolean isFullyCalibrated( void );
+	boolean getSensorOffsets ( uint8_t *calibData );
+	void setSensorOffsets    ( const uint8_t *calibData );
+	/* Interrupts. Thresholds and durations are raw register values, their
+	   units depend on the sensor range (section 4.4). axes: bit 0 x, 1 y, 2 z */
+	void enableAnyMotion     ( uint8_t threshold, uint8_t duration, uint8_t axes = 0x07 );
+	void enableNoMotion      ( uint8_t threshold, uint8_t duration, uint8_t axes = 0x07 );
+	void enableHighG         ( uint8_t threshold, uint8_t duration, uint8_t axes = 0x07 );
+	void enableHighRate      ( uint8_t threshold, uint8_t duration, uint8_t axes = 0x07 );
+	void enableGyroAnyMotion ( uint8_t threshold, uint8_t samples, uint8_t axes = 0x07 );
+	void disableInterrupts   ( uint8_t mask );
+	uint8_t getInterruptStatus( void );
+	void resetInterrupts     ( void );
 	imu::Vector<3>  getVector ( i2c_vector_type_t vector_type );
       imu::Quaternion getQuat   ( void );
 	
 	int readI2C() { return 0; } // Unused
 	
 private:
+	typedef struct {
+	  uint8_t reg, mask, value;
+	} page1_update_t;
+	void updatePage1(const page1_update_t *updates, int count);
+
 	int _i2c_address;
 	i2c_bno055_opmode_t _mode;
+	boolean _warm_start = false;
+	uint64_t _startup_us = 0;
 
 };
 
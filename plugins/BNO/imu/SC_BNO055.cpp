@@ -21,20 +21,28 @@ https://github.com/theleadingzero/belaonurhead
 Johannes Burström 2021
 */
 
-#include "Bela.h"
+#include <string.h>
+#include "BNO_Platform.h"
 #include "SC_BNO055.h"
+#include "BNO_Stream.h"
+#include "BNO_Log.h"
 
-bool SC_BNO055::setup() {
-	if(!bno.begin()) {
+SC_BNO055::~SC_BNO055() {
+	stopRecording();
+	delete mReplay;
+}
+
+bool SC_BNO055::setup(uint8_t bus, uint8_t address) {
+	mBus = bus;
+	mAddress = address;
+	// use external crystal for better accuracy
+	if(!bno.begin(bus, address, I2C_BNO055::OPERATION_MODE_IMUPLUS, true)) {
 		rt_printf("Error initialising BNO055\n");
 		return false;
 	}
 
-	rt_printf("Initialised BNO055\n");
+	rt_printf("Initialised BNO055 (%s start, %d ms)\n", bno.warmStarted() ? "warm" : "cold", (int)(bno.startupTime() / 1000));
 	
-	// use external crystal for better accuracy
-  	bno.setExtCrystalUse(true);
-  	
 	// get the system status of the sensor to make sure everything is ok
 	uint8_t sysStatus, selfTest, sysError;
   	bno.getSystemStatus(&sysStatus, &selfTest, &sysError);
@@ -43,11 +51,55 @@ bool SC_BNO055::setup() {
 	return true;
 }
 
+bool SC_BNO055::setupReplay(const char *path, float speed, bool loop) {
+	delete mReplay;
+	mReplay = new BNO_Replay();
+	if (!mReplay->open(path)) {
+		rt_printf("Error opening BNO055 replay file %s\n", path);
+		delete mReplay;
+		mReplay = nullptr;
+		return false;
+	}
+	mReplay->setSpeed(speed);
+	mReplay->setLoop(loop);
+	rt_printf("Replaying BNO055 stream from %s\n", path);
+	return true;
+}
+
+bool SC_BNO055::startRecording(const char *path) {
+	stopRecording();
+	mRecorder = new BNO_Recorder();
+	if (!mRecorder->open(path)) {
+		delete mRecorder;
+		mRecorder = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void SC_BNO055::stopRecording() {
+	delete mRecorder;
+	mRecorder = nullptr;
+}
+
 void SC_BNO055::setCalibration(bnoCalibration_t calData)
 {
 	mIdleConj = calData.idleConj;
 	mGravCal = calData.gravCal;
 	mGravIdle = calData.gravIdle;
+	mHasNextIdle = false;
+	updateCalibration();
+	setMagCorrection(calData.hasMagCorrection ? &calData.magCorrection : nullptr);
+
+	if (calData.hasSensorOffsets) {
+		memcpy(mSensorOffsets, calData.sensorOffsets, NUM_BNO055_OFFSET_REGISTERS);
+		mHasSensorOffsets = true;
+		// Restoring resets fusion, so leave a chip that is already calibrated alone
+		if (mReplay == nullptr && !bno.isFullyCalibrated()) {
+			bno.setSensorOffsets(mSensorOffsets);
+			bnoLog(BNO_LOG_OFFSETS_RESTORED);
+		}
+	}
 }
 
 void SC_BNO055::getCalibration(bnoCalibration_t &calData)
@@ -55,66 +107,318 @@ void SC_BNO055::getCalibration(bnoCalibration_t &calData)
     calData.idleConj = mIdleConj;
     calData.gravCal = mGravCal;
     calData.gravIdle = mGravIdle;
+    memcpy(calData.sensorOffsets, mSensorOffsets, NUM_BNO055_OFFSET_REGISTERS);
+    calData.hasSensorOffsets = mHasSensorOffsets;
+    calData.magCorrection = mMagCorrection;
+    calData.hasMagCorrection = mHasMagCorrection;
 }
 
+void SC_BNO055::setMagCorrection(const bnoMagCorrection_t *correction)
+{
+	if (correction != nullptr) {
+		mMagCorrection = *correction;
+	}
+	mHasMagCorrection = correction != nullptr;
+}
 
+void SC_BNO055::setDriftCompensation(bool enabled)
+{
+	if (enabled && !mDriftCompensation) {
+		mDrift.reset();
+	}
+	mDriftCompensation = enabled;
+}
+
+void SC_BNO055::setReference(const BNO_Relative *reference)
+{
+	mReference = reference;
+	mRelQuat = { BNO_QUAT_ONE, 0.f, 0.f, 0.f };
+	mDrift.reset();
+}
+
+void SC_BNO055::setFilter(int type, const bnoFilterConfig_t &config)
+{
+	if (type == BNO_QUAT) {
+		mQuatFilter.configure(config);
+	} else if (type >= BNO_ACCEL && type < BNO_QUAT) {
+		mFilters[type].configure(config);
+	}
+}
+
+// Set the operating mode of the chip, see I2C_BNO055::i2c_bno055_opmode_t
+void SC_BNO055::setMode(int mode) {
+	if (mReplay == nullptr) {
+		bno.setMode((I2C_BNO055::i2c_bno055_opmode_t)mode);
+	}
+}
+
+// Chip interrupt bit for each bnoInterrupt
+static const uint8_t bnoInterruptBits[BNO_NUM_INTERRUPTS] = {
+	I2C_BNO055::INTR_ACC_AM,
+	I2C_BNO055::INTR_ACC_NM,
+	I2C_BNO055::INTR_ACC_HIGH_G,
+	I2C_BNO055::INTR_GYR_HIGH_RATE
+};
+
+void SC_BNO055::setInterrupt(int type, int threshold, int duration, int axes) {
+	if (mReplay != nullptr || type < 0 || type >= BNO_NUM_INTERRUPTS) {
+		return;
+	}
+	uint8_t bit = bnoInterruptBits[type];
+	if (threshold < 0) {
+		bno.disableInterrupts(bit);
+		mInterruptMask &= ~bit;
+		return;
+	}
+	switch (type) {
+	case BNO_INT_ANY_MOTION:
+		bno.enableAnyMotion(threshold, duration, axes);
+		break;
+	case BNO_INT_NO_MOTION:
+		bno.enableNoMotion(threshold, duration, axes);
+		break;
+	case BNO_INT_HIGH_G:
+		bno.enableHighG(threshold, duration, axes);
+		break;
+	case BNO_INT_HIGH_RATE:
+		bno.enableHighRate(threshold, duration, axes);
+		break;
+	}
+	mInterruptMask |= bit;
+}
+
+// The status is latched by the chip, so polling it every few milliseconds
+// only adds latency, not missed events
+#define BNO_INTERRUPT_POLL 2000
+
+void SC_BNO055::pollInterrupts() {
+	if (mFrame.time - mLastInterruptPoll < BNO_INTERRUPT_POLL) {
+		return;
+	}
+	mLastInterruptPoll = mFrame.time;
+
+	uint8_t status = bno.getInterruptStatus() & mInterruptMask;
+	if (status == 0) {
+		return;
+	}
+	for (int i = 0; i < BNO_NUM_INTERRUPTS; ++i) {
+		if (status & bnoInterruptBits[i]) {
+			mInterruptCounts[i]++;
+		}
+	}
+	bno.resetInterrupts();
+}
 
 // Auxiliary task to read from the I2C board
 void SC_BNO055::readIMU(bnoState_t &state)
 {
-	// get calibration status
-	uint8_t sys, gyro, accel, mag;
+	if (readFrame(mFrame)) {
+		if (mInterruptMask != 0 && mReplay == nullptr) {
+			pollInterrupts();
+		}
+		processFrame(mFrame, state);
+		if (!mFullyCalibrated && mReplay == nullptr) {
+			captureSensorOffsets();
+		}
+	}
+}
 
-	bno.getCalibration(&sys, &gyro, &accel, &mag);
+// Grab the chip's offsets the first time it reports full calibration,
+// so they can be saved with the calibration
+void SC_BNO055::captureSensorOffsets()
+{
+	uint8_t calib = mFrame.data[I2C_BNO055::BNO055_CALIB_STAT_ADDR - BNO_FRAME_FIRST_REG];
+	// accel and gyro at 3 is enough in IMUPLUS mode, see I2C_BNO055::isFullyCalibrated
+	if ((calib & 0x3C) != 0x3C || !bno.isFullyCalibrated()) {
+		return;
+	}
+	mFullyCalibrated = true;
+	if (bno.getSensorOffsets(mSensorOffsets)) {
+		mHasSensorOffsets = true;
+		bnoLog(BNO_LOG_FULLY_CALIBRATED);
+	}
+}
 
-    imu::Vector<3> vec;
+// Read one frame, from the device or from the replay stream
+bool SC_BNO055::readFrame(bnoRawFrame_t &frame)
+{
+	if (mReplay) {
+		return mReplay->readFrame(frame);
+	}
 
+	// one burst for all data registers instead of a transfer per byte
+	if (!bno.readLen(BNO_FRAME_FIRST_REG, frame.data, BNO_FRAME_BYTES)) {
+		return false;
+	}
+	frame.time = bnoTimeUs();
 
-    vec = bno.getVector(I2C_BNO055::VECTOR_ACCELEROMETER);
-    state.ax = vec.x();
-    state.ay = vec.y();
-    state.az = vec.z();
+	if (mRecorder) {
+		mRecorder->write(frame);
+	}
+	return true;
+}
 
-    vec = bno.getVector(I2C_BNO055::VECTOR_GYROSCOPE);
-    state.gx = vec.x();
-    state.gy = vec.y();
-    state.gz = vec.z();
+// Decode, calibrate and publish a frame
+// Values stay raw int16, scaling is left to the consumer
+void SC_BNO055::processFrame(const bnoRawFrame_t &frame, bnoState_t &state)
+{
+	if (&frame != &mFrame) {
+		mFrame = frame;
+	}
 
-    vec = bno.getVector(I2C_BNO055::VECTOR_MAGNETOMETER);
-    state.mx = vec.x();
-    state.my = vec.y();
-    state.mz = vec.z();
+	const uint8_t *p = frame.data;
+	int16_t v[BNO_FRAME_BYTES / 2];
+	for (int i = 0; i < BNO_FRAME_BYTES / 2; ++i) {
+		v[i] = (int16_t)(p[2*i] | (p[2*i + 1] << 8));
+	}
 
-	
-	// quaternion data routine from MrHeadTracker
-  	imu::Quaternion qRaw = bno.getQuat(); //get sensor raw quaternion data
-  	
-  	steering = mIdleConj * qRaw; // calculate relative rotation data
-  	quat = mCalLeft * steering; // transform it to calibrated coordinate system
-  	quat = quat * mCalRight;
+	// register block order is accel, mag, gyro, euler, quat
+	const int accel = (I2C_BNO055::BNO055_ACCEL_DATA_X_LSB_ADDR - BNO_FRAME_FIRST_REG) / 2;
+	const int mag = (I2C_BNO055::BNO055_MAG_DATA_X_LSB_ADDR - BNO_FRAME_FIRST_REG) / 2;
+	const int gyro = (I2C_BNO055::BNO055_GYRO_DATA_X_LSB_ADDR - BNO_FRAME_FIRST_REG) / 2;
+	const int q = (I2C_BNO055::BNO055_QUATERNION_DATA_W_LSB_ADDR - BNO_FRAME_FIRST_REG) / 2;
+	for (int i = 0; i < 3; ++i) {
+		mOut.accel[i] = v[accel + i];
+		mOut.gyro[i] = v[gyro + i];
+		mOut.mag[i] = v[mag + i];
+	}
+	if (mHasMagCorrection) {
+		float raw[3], corrected[3];
+		bnoScaleValues(mOut.mag, raw, 3, BNO_MAG);
+		bnoApplyMagCorrection(mMagCorrection, raw, corrected);
+		for (int i = 0; i < 3; ++i) {
+			// a large soft-iron scale can leave the int16 range
+			mOut.mag[i] = (int16_t)lrintf(fmaxf(-32768.f, fminf(32767.f, corrected[i] / bnoScale[BNO_MAG])));
+		}
+	}
+	// filtered in place on the raw values, the scale doesn't matter to the filters
+	int16_t *vectors[3] = { mOut.accel, mOut.gyro, mOut.mag };
+	for (int type = BNO_ACCEL; type < BNO_QUAT; ++type) {
+		if (mFilters[type].active()) {
+			float values[3];
+			for (int i = 0; i < 3; ++i) {
+				values[i] = vectors[type][i];
+			}
+			mFilters[type].process(frame.time, values);
+			for (int i = 0; i < 3; ++i) {
+				vectors[type][i] = (int16_t)lrintf(fmaxf(-32768.f, fminf(32767.f, values[i])));
+			}
+		}
+	}
+	mOut.calib = p[I2C_BNO055::BNO055_CALIB_STAT_ADDR - BNO_FRAME_FIRST_REG];
+	mOut.time = frame.time;
+
+	// quaternion data routine from MrHeadTracker,
+	// with the calibration quaternions premultiplied
+	bnoQuatf_t qRaw = { (float)v[q], (float)v[q + 1], (float)v[q + 2], (float)v[q + 3] };
+	if (mReference != nullptr) {
+		// without a current reference, hold the last relative orientation
+		if (mReference->relative(frame.time, qRaw)) {
+			mRelQuat = qRaw;
+		}
+		qRaw = mRelQuat;
+	} else if (mDriftCompensation) {
+		float gyroValues[3], accelValues[3];
+		bnoScaleValues(mOut.gyro, gyroValues, 3, BNO_GYRO);
+		bnoScaleValues(mOut.accel, accelValues, 3, BNO_ACCEL);
+		qRaw = mDrift.update(frame.time, gyroValues, accelValues, qRaw);
+	}
+	bnoQuatf_t quat = bnoQuatMul(bnoQuatMul(mCalPre, qRaw), mCalPost);
+	if (mQuatFilter.active()) {
+		float norm = sqrtf(quat.w * quat.w + quat.x * quat.x + quat.y * quat.y + quat.z * quat.z);
+		if (norm > 0.f) {
+			float k = 1.f / norm;
+			quat.w *= k; quat.x *= k; quat.y *= k; quat.z *= k;
+			mQuatFilter.process(frame.time, quat);
+			quat.w *= BNO_QUAT_ONE; quat.x *= BNO_QUAT_ONE; quat.y *= BNO_QUAT_ONE; quat.z *= BNO_QUAT_ONE;
+		}
+	}
+	mOut.quat[0] = (int16_t)lrintf(quat.w);
+	mOut.quat[1] = (int16_t)lrintf(quat.x);
+	mOut.quat[2] = (int16_t)lrintf(quat.y);
+	mOut.quat[3] = (int16_t)lrintf(quat.z);
+
+	const double qScale = 1.0 / BNO_QUAT_ONE;
+	mFeatures.update(frame.time, lastLinearAccel(),
+		imu::Quaternion(qScale * quat.w, qScale * quat.x, qScale * quat.y, qScale * quat.z), mOut.features);
+	if (mFeatures.linearChanged()) {
+		mOnset.add(frame.time, mOut.features[BNO_JERK], mOut.features[BNO_LINEAR_ACCEL]);
+	}
+	mOut.onsetCount = mOnset.count();
+	mOut.onsetStrength = mOnset.strength();
+	mOut.onsetTime = mOnset.time();
+	memcpy(mOut.interruptCounts, mInterruptCounts, sizeof(mInterruptCounts));
+
+	bnoPublish(state, mOut);
+}
 
-    //Yaw, Pitch, Roll, Yaw
-    vec = quat.toEuler(); // transform from quaternion to Euler
-    state.yaw = vec[0];
-    state.pitch = vec[1];
-    state.roll = vec[2];
+// Vector starting at register reg of the current frame
+imu::Vector<3> SC_BNO055::frameVector(int reg, double scale) const
+{
+	const uint8_t *p = mFrame.data + (reg - BNO_FRAME_FIRST_REG);
+	int16_t x = (int16_t)(p[0] | (p[1] << 8));
+	int16_t y = (int16_t)(p[2] | (p[3] << 8));
+	int16_t z = (int16_t)(p[4] | (p[5] << 8));
+	return imu::Vector<3>(scale * x, scale * y, scale * z);
+}
 
+// Quaternion of the current frame
+imu::Quaternion SC_BNO055::frameQuat() const
+{
+	const uint8_t *p = mFrame.data + (I2C_BNO055::BNO055_QUATERNION_DATA_W_LSB_ADDR - BNO_FRAME_FIRST_REG);
+	int16_t w = (int16_t)(p[0] | (p[1] << 8));
+	int16_t x = (int16_t)(p[2] | (p[3] << 8));
+	int16_t y = (int16_t)(p[4] | (p[5] << 8));
+	int16_t z = (int16_t)(p[6] | (p[7] << 8));
+	/* See 3.6.5.5 Orientation (Quaternion) */
+	const double scale = (1.0 / (1<<14));
+	return imu::Quaternion(scale * w, scale * x, scale * y, scale * z);
 }
 
-// Auxiliary task to read from the I2C board
-void SC_BNO055::getNeutralGravity() {
-	// read in gravity value
-  	imu::Vector<3> gravity = bno.getVector(I2C_BNO055::VECTOR_GRAVITY);
-    mIdleConj = bno.getQuat().conjugate(); // sets what is looking forward
+// Gravity of the last frame read, in m/s^2
+imu::Vector<3> SC_BNO055::lastGravity() const
+{
+	return frameVector(I2C_BNO055::BNO055_GRAVITY_DATA_X_LSB_ADDR, 1.0 / 100.0);
+}
+
+// Linear acceleration (gravity removed) of the last frame read, in m/s^2
+imu::Vector<3> SC_BNO055::lastLinearAccel() const
+{
+	return frameVector(I2C_BNO055::BNO055_LINEAR_ACCEL_DATA_X_LSB_ADDR, 1.0 / 100.0);
+}
+
+// Uncorrected magnetometer of the last frame read, in uT
+void SC_BNO055::lastMag(float *mag) const
+{
+	imu::Vector<3> vec = frameVector(I2C_BNO055::BNO055_MAG_DATA_X_LSB_ADDR, 1.0 / 16.0);
+	mag[0] = vec.x();
+	mag[1] = vec.y();
+	mag[2] = vec.z();
+}
+
+// Raw (uncalibrated) orientation of the last frame read, relative to the
+// reference if there is one, so calibration captures the relative orientation
+imu::Quaternion SC_BNO055::lastQuat() const
+{
+	if (mReference != nullptr) {
+		const double scale = 1.0 / BNO_QUAT_ONE;
+		return imu::Quaternion(scale * mRelQuat.w, scale * mRelQuat.x, scale * mRelQuat.y, scale * mRelQuat.z);
+	}
+	return frameQuat();
+}
+
+// Calibration step 1, neutral position. Takes effect in recalcCalibration,
+// so the published orientation stays consistent between the steps.
+void SC_BNO055::setNeutralGravity(imu::Vector<3> gravity, const imu::Quaternion &quat) {
+    mNextIdleConj = quat.conjugate(); // sets what is looking forward
+    mHasNextIdle = true;
   	gravity = gravity.scale(-1);
   	gravity.normalize();
   	mGravIdle = gravity;
 }
 
-// Auxiliary task to read from the I2C board
-void SC_BNO055::getDownGravity() {
-	// read in gravity value
-  	imu::Vector<3> gravity = bno.getVector(I2C_BNO055::VECTOR_GRAVITY);
+// Calibration step 2, tilted down
+void SC_BNO055::setDownGravity(imu::Vector<3> gravity) {
   	gravity = gravity.scale(-1);
   	gravity.normalize();
   	mGravCal = gravity;
@@ -124,6 +428,13 @@ void SC_BNO055::getDownGravity() {
 // see http://www.aes.org/e-lib/browse.cfm?elib=18567 for full paper
 // describing algorithm
 void SC_BNO055::recalcCalibration() {
+	if (mHasNextIdle) {
+		mIdleConj = mNextIdleConj;
+		mHasNextIdle = false;
+	}
+	// the neutral position was captured from the uncorrected orientation
+	mDrift.reset();
+
   	imu::Vector<3> g, gravCalTemp, x, y, z;
   	g = mGravIdle; // looking forward in neutral position
   
@@ -158,4 +469,13 @@ void SC_BNO055::recalcCalibration() {
 void SC_BNO055::resetOrientation() {
   	mCalLeft = mCal.conjugate();
   	mCalRight = mCal;
+  	updateCalibration();
+}
+
+// quat = mCalLeft * (mIdleConj * qRaw) * mCalRight, so the constant
+// parts can be combined once, in float, for the reader
+void SC_BNO055::updateCalibration() {
+	imu::Quaternion pre = mCalLeft * mIdleConj;
+	mCalPre = { (float)pre.w(), (float)pre.x(), (float)pre.y(), (float)pre.z() };
+	mCalPost = { (float)mCalRight.w(), (float)mCalRight.x(), (float)mCalRight.y(), (float)mCalRight.z() };
 }
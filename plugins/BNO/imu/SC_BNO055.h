@@ -12,43 +12,151 @@
   Johannes Burström 2021
 */
 
+#ifndef SC_BNO055_H_
+#define SC_BNO055_H_
+
 #include <atomic>
+#include <stdint.h>
+#include <time.h>
 #include "Bela_BNO055.h"
+#include "BNO_Frame.h"
+#include "BNO_MagFit.h"
+#include "BNO_Drift.h"
+#include "BNO_Filter.h"
+#include "BNO_Features.h"
+#include "BNO_Onset.h"
+#include "BNO_Relative.h"
+
+class BNO_Replay;
+class BNO_Recorder;
+
+// First and last register of the block read from the chip for every frame:
+// accel, mag, gyro, euler, quaternion, linear accel, gravity, temp and calib status
+#define BNO_FRAME_FIRST_REG I2C_BNO055::BNO055_ACCEL_DATA_X_LSB_ADDR
+#define BNO_FRAME_LAST_REG I2C_BNO055::BNO055_CALIB_STAT_ADDR
+#define BNO_FRAME_BYTES (BNO_FRAME_LAST_REG - BNO_FRAME_FIRST_REG + 1)
+
+// One sensor read, exactly as it came off the bus.
+// This is also the on-disk frame format of recorded streams, so keep it fixed-size.
+typedef struct {
+	uint64_t time; // microseconds, monotonic
+	uint8_t data[BNO_FRAME_BYTES];
+	uint8_t pad[8 - BNO_FRAME_BYTES % 8];
+} bnoRawFrame_t;
 
-typedef struct  {
-    std::atomic<float> ax, ay, az, gx, gy, gz, mx, my, mz, pitch, roll, yaw;
-} bnoState_t;
+// Monotonic time in microseconds, used for frame timestamps
+static inline uint64_t bnoTimeUs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
 
 typedef struct {
 	imu::Quaternion idleConj;
 	imu::Vector<3> gravIdle;
 	imu::Vector<3> gravCal;
+	// the chip's own accel/mag/gyro offsets and radii
+	uint8_t sensorOffsets[NUM_BNO055_OFFSET_REGISTERS];
+	bool hasSensorOffsets;
+	// software hard/soft-iron correction of the magnetometer
+	bnoMagCorrection_t magCorrection;
+	bool hasMagCorrection;
 } bnoCalibration_t;
 
 class SC_BNO055 {
 public:
 	SC_BNO055() {};
-	bool setup();
+	~SC_BNO055();
+	bool setup(uint8_t bus = 1, uint8_t address = BNO055_ADDRESS_A);
+	// Use a recorded stream instead of the I2C device
+	bool setupReplay(const char *path, float speed = 1.f, bool loop = false);
+	// False if the file can't be opened
+	bool startRecording(const char *path);
+	void stopRecording();
 	void setCalibration(bnoCalibration_t calData);
 	void getCalibration(bnoCalibration_t &calData);
 	// function declarations
 	void readIMU(bnoState_t &state);
-	void getNeutralGravity();
-	void getDownGravity();
+	bool readFrame(bnoRawFrame_t &frame);
+	void processFrame(const bnoRawFrame_t &frame, bnoState_t &state);
+	imu::Vector<3> lastGravity() const;
+	imu::Vector<3> lastLinearAccel() const;
+	imu::Quaternion lastQuat() const;
+	// Last frame published, with the calibrated orientation
+	const bnoFrame_t &lastOutput() const { return mOut; }
+	void lastMag(float *mag) const;
+	// nullptr to disable the correction
+	void setMagCorrection(const bnoMagCorrection_t *correction);
+	// Compensate the slow heading drift of the fusion output
+	void setDriftCompensation(bool enabled);
+	// Smoothing for one bnoValueType, applied before publishing
+	void setFilter(int type, const bnoFilterConfig_t &config);
+	// see BNO_Onset::setParameters
+	void setOnsetParameters(float sensitivity, float minimum, uint64_t refractory) { mOnset.setParameters(sensitivity, minimum, refractory); }
+	void setNeutralGravity(imu::Vector<3> gravity, const imu::Quaternion &quat);
+	void setDownGravity(imu::Vector<3> gravity);
 	void recalcCalibration();
-
-
+	void setMode(int mode);
+	// Enable a bnoInterrupt with raw threshold and duration, see I2C_BNO055.
+	// A negative threshold disables it.
+	void setInterrupt(int type, int threshold, int duration, int axes = 0x07);
+	// Publish the orientation relative to a reference sensor instead,
+	// nullptr to go back to the absolute orientation. Drift compensation
+	// is not applied to relative orientations.
+	void setReference(const BNO_Relative *reference);
+	// Identifies the sensor in the calibration store. Relative orientations
+	// have their own calibration.
+	uint32_t sensorId() const { return (mReference ? 0x10000 : 0) | (mBus << 8) | mAddress; }
 
 private:
 	I2C_BNO055 bno; // IMU sensor object
+	uint8_t mBus = 1, mAddress = BNO055_ADDRESS_A;
+	BNO_Replay *mReplay = nullptr;
+	BNO_Recorder *mRecorder = nullptr;
+	bnoRawFrame_t mFrame = {}; // last frame read
+	bnoFrame_t mOut = {}; // last frame published
+	// combined calibration, quat = mCalPre * qRaw * mCalPost
+	bnoQuatf_t mCalPre = {1.f, 0.f, 0.f, 0.f}, mCalPost = {1.f, 0.f, 0.f, 0.f};
+
+	imu::Vector<3> frameVector(int reg, double scale) const;
+	imu::Quaternion frameQuat() const;
 
 	// Quaternions and Vectors
 	imu::Quaternion mCalLeft, mCalRight, mCal, mIdleConj = {1, 0, 0, 0};
-	imu::Quaternion quat, steering, qRaw;
 
 	imu::Vector<3> mGravIdle, mGravCal;
+	imu::Quaternion mNextIdleConj;
+	bool mHasNextIdle = false;
+
+	uint8_t mSensorOffsets[NUM_BNO055_OFFSET_REGISTERS] = {};
+	bool mHasSensorOffsets = false;
+	bool mFullyCalibrated = false;
+
+	bnoMagCorrection_t mMagCorrection = {};
+	bool mHasMagCorrection = false;
+
+	BNO_Drift mDrift;
+	bool mDriftCompensation = false;
+
+	const BNO_Relative *mReference = nullptr;
+	bnoQuatf_t mRelQuat = { BNO_QUAT_ONE, 0.f, 0.f, 0.f }; // last relative orientation, raw
+
+	BNO_VectorFilter mFilters[3]; // accel, gyro, mag
+	BNO_QuatFilter mQuatFilter;
+
+	BNO_Features mFeatures;
+	BNO_Onset mOnset;
+
+	uint8_t mInterruptMask = 0; // enabled I2C_BNO055::i2c_bno055_intr_t bits
+	uint8_t mInterruptCounts[BNO_NUM_INTERRUPTS] = {};
+	uint64_t mLastInterruptPoll = 0;
 
 	//int printThrottle = 0; // used to limit printing frequency
 	void resetOrientation();
+	void updateCalibration();
+	void captureSensorOffsets();
+	void pollInterrupts();
 
 };
+
+#endif /* SC_BNO055_H_ */
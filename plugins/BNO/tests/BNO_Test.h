@@ -0,0 +1,47 @@
+/*
+  Test helpers
+  ----------------------------------------------------------
+  The tests are plain programs that exercise one module without a server
+  or a sensor. Each check prints where it failed, and the program exits
+  with 1 if any did, which is all ctest looks at.
+
+  Johannes Burström 2021
+*/
+
+#ifndef BNO_TEST_H_
+#define BNO_TEST_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static int gTestFailures = 0;
+
+#define BNO_CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		gTestFailures++; \
+	} \
+} while (0)
+
+#define BNO_CHECK_NEAR(a, b, tolerance) do { \
+	double a_ = (a), b_ = (b); \
+	if (!(fabs(a_ - b_) <= (tolerance))) { \
+		printf("%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #a, a_, b_); \
+		gTestFailures++; \
+	} \
+} while (0)
+
+// A file name in /tmp for this test run
+static inline const char *bnoTestPath(char *buf, size_t size, const char *name) {
+	snprintf(buf, size, "/tmp/bno_test_%d_%s", (int)getpid(), name);
+	return buf;
+}
+
+// Exit status of main
+static inline int bnoTestResult(const char *name) {
+	printf("%s: %s\n", name, gTestFailures == 0 ? "ok" : "FAILED");
+	return gTestFailures == 0 ? 0 : 1;
+}
+
+#endif /* BNO_TEST_H_ */
@@ -0,0 +1,113 @@
+/*
+  BNO_Calibration: profiles survive a save and load, a damaged file is
+  rejected, and a legacy file is read as one profile.
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "../imu/BNO_Calibration.h"
+#include "BNO_Test.h"
+
+static bnoCalibration_t makeCalibration(float seed) {
+	bnoCalibration_t calData = {};
+	calData.idleConj = imu::Quaternion(0.5, 0.5, -0.5, seed);
+	calData.gravIdle = imu::Vector<3>(0.0, 0.0, 9.8 + seed);
+	calData.gravCal = imu::Vector<3>(0.0, 9.8 - seed, 0.0);
+	for (int i = 0; i < NUM_BNO055_OFFSET_REGISTERS; ++i) {
+		calData.sensorOffsets[i] = (uint8_t)(i + 1);
+	}
+	calData.hasSensorOffsets = true;
+	for (int i = 0; i < 3; ++i) {
+		calData.magCorrection.offset[i] = seed * (i + 1);
+	}
+	for (int i = 0; i < 9; ++i) {
+		calData.magCorrection.matrix[i] = i % 4 == 0 ? 1.f : 0.f;
+	}
+	calData.hasMagCorrection = true;
+	return calData;
+}
+
+static void testRoundTrip(const char *path) {
+	BNO_CalibrationStore store;
+	BNO_CHECK(store.put(1, "0", makeCalibration(0.25f)) == 0);
+	BNO_CHECK(store.put(1, "stage", makeCalibration(0.5f)) == 1);
+	BNO_CHECK(store.put(2, "0", makeCalibration(0.75f)) == 2);
+	// replacing keeps the index
+	BNO_CHECK(store.put(1, "stage", makeCalibration(0.125f)) == 1);
+	BNO_CHECK(store.size() == 3);
+	BNO_CHECK(store.save(path));
+
+	BNO_CalibrationStore loaded;
+	BNO_CHECK(loaded.load(path));
+	BNO_CHECK(loaded.size() == 3);
+	BNO_CHECK(loaded.find(1, "stage") == 1);
+	BNO_CHECK(loaded.find(2, "stage") == -1);
+	BNO_CHECK(strcmp(loaded.name(2), "0") == 0);
+
+	bnoCalibration_t calData;
+	BNO_CHECK(loaded.get(loaded.find(1, "stage"), calData));
+	BNO_CHECK_NEAR(calData.idleConj.z(), 0.125, 1e-6);
+	BNO_CHECK_NEAR(calData.gravIdle[2], 9.925, 1e-5);
+	BNO_CHECK_NEAR(calData.gravCal[1], 9.675, 1e-5);
+	BNO_CHECK(calData.sensorOffsets[NUM_BNO055_OFFSET_REGISTERS - 1] == NUM_BNO055_OFFSET_REGISTERS);
+	BNO_CHECK(calData.hasSensorOffsets);
+	BNO_CHECK(calData.hasMagCorrection);
+	BNO_CHECK_NEAR(calData.magCorrection.offset[2], 0.375, 1e-6);
+	BNO_CHECK_NEAR(calData.magCorrection.matrix[8], 1.0, 1e-6);
+	BNO_CHECK(!loaded.get(3, calData));
+}
+
+// A flipped byte in a profile fails the checksum
+static void testCorrupt(const char *path) {
+	FILE *fp = fopen(path, "r+b");
+	BNO_CHECK(fp != NULL);
+	if (fp == NULL) {
+		return;
+	}
+	fseek(fp, sizeof(bnoCalHeader_t) + 40, SEEK_SET);
+	int c = fgetc(fp);
+	fseek(fp, sizeof(bnoCalHeader_t) + 40, SEEK_SET);
+	fputc(c ^ 0x10, fp);
+	fclose(fp);
+
+	BNO_CalibrationStore store;
+	BNO_CHECK(!store.load(path));
+	BNO_CHECK(store.size() == 0);
+}
+
+static void testLegacy(const char *path) {
+	double values[10] = { 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 9.8, 0.0, 9.8, 0.0 };
+	FILE *fp = fopen(path, "wb");
+	fwrite(values, sizeof(values), 1, fp);
+	fclose(fp);
+
+	BNO_CalibrationStore store;
+	// not the current format
+	BNO_CHECK(!store.load(path));
+	BNO_CHECK(store.loadLegacy(path, 7, "0"));
+	BNO_CHECK(store.size() == 1);
+	bnoCalibration_t calData;
+	BNO_CHECK(store.get(store.find(7, "0"), calData));
+	BNO_CHECK_NEAR(calData.idleConj.w(), 1.0, 1e-6);
+	BNO_CHECK_NEAR(calData.gravIdle[2], 9.8, 1e-5);
+	BNO_CHECK_NEAR(calData.gravCal[1], 9.8, 1e-5);
+	BNO_CHECK(!calData.hasSensorOffsets);
+
+	// anything after the ten values is not a legacy file
+	fp = fopen(path, "ab");
+	fputc(0, fp);
+	fclose(fp);
+	BNO_CHECK(!store.loadLegacy(path, 7, "0"));
+}
+
+int main() {
+	char path[256];
+	bnoTestPath(path, sizeof(path), "calibration");
+	testRoundTrip(path);
+	testCorrupt(path);
+	testLegacy(path);
+	unlink(path);
+	return bnoTestResult("calibration");
+}
@@ -0,0 +1,80 @@
+/*
+  BNO_Log: events from several threads are all counted, what doesn't fit
+  in the ring is reported as dropped, and repeats are printed as one line.
+
+  Johannes Burström 2021
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "../imu/BNO_Log.h"
+#include "BNO_Test.h"
+
+#define THREADS 4
+#define EVENTS 50
+
+static void logEvents() {
+	for (int i = 0; i < EVENTS; ++i) {
+		bnoLog(BNO_LOG_GESTURE_SHORT);
+	}
+}
+
+int main() {
+	// unknown codes are ignored
+	bnoLog(-1);
+	bnoLog(BNO_NUM_LOG_CODES);
+	BNO_CHECK(bnoLogCount(BNO_NUM_LOG_CODES) == 0);
+
+	// nothing is printed yet, so the ring fills
+	std::thread threads[THREADS];
+	for (int i = 0; i < THREADS; ++i) {
+		threads[i] = std::thread(logEvents);
+	}
+	for (int i = 0; i < THREADS; ++i) {
+		threads[i].join();
+	}
+	BNO_CHECK(bnoLogCount(BNO_LOG_GESTURE_SHORT) == THREADS * EVENTS);
+	// 256 fit in the ring
+	for (int i = 0; i < 100; ++i) {
+		bnoLog(BNO_LOG_I2C_READ, 0x08, -1);
+	}
+	BNO_CHECK(bnoLogCount(BNO_LOG_I2C_READ) == 100);
+
+	// print to a file instead of the console
+	char path[256];
+	bnoTestPath(path, sizeof(path), "log");
+	fflush(stdout);
+	int console = dup(STDOUT_FILENO);
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	BNO_CHECK(file >= 0);
+	dup2(file, STDOUT_FILENO);
+	close(file);
+	bnoLogStart();
+	bnoLogStop();
+	fflush(stdout);
+	dup2(console, STDOUT_FILENO);
+	close(console);
+
+	char text[4096] = "";
+	FILE *fp = fopen(path, "r");
+	BNO_CHECK(fp != NULL);
+	if (fp != NULL) {
+		text[fread(text, 1, sizeof(text) - 1, fp)] = '\0';
+		fclose(fp);
+	}
+	unlink(path);
+
+	// the first of each code on its own, the rest collapsed
+	BNO_CHECK(strstr(text, "BNO: Gesture too short\n") != NULL);
+	BNO_CHECK(strstr(text, "BNO: Gesture too short (199 times)\n") != NULL);
+	BNO_CHECK(strstr(text, "BNO: I2C read of register 0x08 failed: -1\n") != NULL);
+	BNO_CHECK(strstr(text, "BNO: I2C read of register 0x08 failed: -1 (55 times)\n") != NULL);
+	BNO_CHECK(strstr(text, "BNO: 44 log events dropped\n") != NULL);
+	if (gTestFailures > 0) {
+		printf("%s", text);
+	}
+	return bnoTestResult("log");
+}
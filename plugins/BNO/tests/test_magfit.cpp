@@ -0,0 +1,94 @@
+/*
+  BNO_MagFit: a distorted, offset sphere of samples is fitted back to a
+  sphere around the origin.
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "../imu/BNO_MagFit.h"
+#include "BNO_Test.h"
+
+// Hard-iron offset and a symmetric soft-iron distortion, in uT
+static const float kOffset[3] = { 12.f, -7.f, 20.f };
+static const float kDistortion[9] = {
+	1.2f, 0.1f, 0.f,
+	0.1f, 0.9f, 0.05f,
+	0.f, 0.05f, 1.05f,
+};
+#define FIELD 48.f
+
+// Raw reading for a field direction
+static void reading(float azimuth, float elevation, float *mag) {
+	float field[3] = {
+		FIELD * cosf(elevation) * cosf(azimuth),
+		FIELD * cosf(elevation) * sinf(azimuth),
+		FIELD * sinf(elevation),
+	};
+	for (int i = 0; i < 3; ++i) {
+		mag[i] = kOffset[i];
+		for (int j = 0; j < 3; ++j) {
+			mag[i] += kDistortion[i * 3 + j] * field[j];
+		}
+	}
+}
+
+static void testFit() {
+	BNO_MagFit fit;
+	float mag[3];
+	for (int i = 0; i < 20; ++i) {
+		reading(0.3f * i, 0.1f * (i % 5), mag);
+		fit.add(mag);
+	}
+	bnoMagCorrection_t correction;
+	BNO_CHECK(fit.size() < BNO_MAGFIT_MIN_POINTS);
+	BNO_CHECK(!fit.fit(correction));
+	int before = fit.size();
+
+	// a spiral from pole to pole
+	for (int i = 0; i < 300; ++i) {
+		float elevation = -1.5f + 3.f * i / 300;
+		reading(0.7f * i, elevation, mag);
+		fit.add(mag);
+	}
+	BNO_CHECK(fit.size() >= BNO_MAGFIT_MIN_POINTS);
+	// counted since the last attempt
+	BNO_CHECK(fit.newPoints() == fit.size() - before);
+	BNO_CHECK(fit.fit(correction));
+	BNO_CHECK(fit.newPoints() == 0);
+	for (int i = 0; i < 3; ++i) {
+		BNO_CHECK_NEAR(correction.offset[i], kOffset[i], 0.5);
+	}
+
+	// every direction comes out with the same strength
+	float minNorm = 1e9f, maxNorm = 0.f;
+	for (int i = 0; i < 50; ++i) {
+		float corrected[3];
+		reading(1.3f * i, -1.2f + 0.05f * i, mag);
+		bnoApplyMagCorrection(correction, mag, corrected);
+		float norm = sqrtf(corrected[0] * corrected[0] + corrected[1] * corrected[1]
+			+ corrected[2] * corrected[2]);
+		minNorm = fminf(minNorm, norm);
+		maxNorm = fmaxf(maxNorm, norm);
+	}
+	BNO_CHECK(maxNorm - minNorm < 0.02f * maxNorm);
+}
+
+static void testDecimation() {
+	BNO_MagFit fit;
+	float mag[3] = { 10.f, 20.f, 30.f };
+	BNO_CHECK(fit.add(mag));
+	mag[0] += 0.5f;
+	BNO_CHECK(!fit.add(mag));
+	mag[0] += 5.f;
+	BNO_CHECK(fit.add(mag));
+	BNO_CHECK(fit.size() == 2);
+	fit.reset();
+	BNO_CHECK(fit.size() == 0);
+}
+
+int main() {
+	testFit();
+	testDecimation();
+	return bnoTestResult("magfit");
+}
@@ -0,0 +1,97 @@
+/*
+  BNO_Rotation: the rotation of a quaternion turns the right way, and the
+  ambisonic blocks rotate the spherical harmonics of a direction into
+  those of the rotated direction, Y(R d) = M Y(d).
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include "../imu/BNO_Rotation.h"
+#include "BNO_Test.h"
+
+// Real spherical harmonics of orders 1 to 3 in ACN order, SN3D
+static void harmonics(const float *d, float *y) {
+	float x = d[0], yy = d[1], z = d[2];
+	y[0] = 1.f;
+	y[1] = yy;
+	y[2] = z;
+	y[3] = x;
+	y[4] = sqrtf(3.f) * x * yy;
+	y[5] = sqrtf(3.f) * yy * z;
+	y[6] = 0.5f * (3.f * z * z - 1.f);
+	y[7] = sqrtf(3.f) * x * z;
+	y[8] = 0.5f * sqrtf(3.f) * (x * x - yy * yy);
+	y[9] = sqrtf(5.f / 8.f) * yy * (3.f * x * x - yy * yy);
+	y[10] = sqrtf(15.f) * x * yy * z;
+	y[11] = sqrtf(3.f / 8.f) * yy * (5.f * z * z - 1.f);
+	y[12] = 0.5f * z * (5.f * z * z - 3.f);
+	y[13] = sqrtf(3.f / 8.f) * x * (5.f * z * z - 1.f);
+	y[14] = 0.5f * sqrtf(15.f) * z * (x * x - yy * yy);
+	y[15] = sqrtf(5.f / 8.f) * x * (x * x - 3.f * yy * yy);
+}
+
+static void rotate(const float *r, const float *v, float *out) {
+	for (int i = 0; i < 3; ++i) {
+		out[i] = r[i * 3] * v[0] + r[i * 3 + 1] * v[1] + r[i * 3 + 2] * v[2];
+	}
+}
+
+static bnoQuatf_t axisAngle(float x, float y, float z, float angle) {
+	float s = sinf(angle / 2.f) / sqrtf(x * x + y * y + z * z);
+	bnoQuatf_t q = { cosf(angle / 2.f), x * s, y * s, z * s };
+	return q;
+}
+
+static void testQuatToMatrix() {
+	float r[9];
+	bnoQuatToMatrix(axisAngle(0.f, 0.f, 1.f, (float)M_PI / 2.f), r);
+	const float x[3] = { 1.f, 0.f, 0.f };
+	float v[3];
+	rotate(r, x, v);
+	// counterclockwise about z, x turns to y
+	BNO_CHECK_NEAR(v[0], 0.0, 1e-6);
+	BNO_CHECK_NEAR(v[1], 1.0, 1e-6);
+	BNO_CHECK_NEAR(v[2], 0.0, 1e-6);
+}
+
+static void testHoaRotation(const bnoQuatf_t &q) {
+	float r[9];
+	float matrix[BNO_HOA_MATRIX_SIZE];
+	bnoQuatToMatrix(q, r);
+	bnoHoaRotation(r, BNO_HOA_MAX_ORDER, matrix);
+
+	for (int k = 0; k < 10; ++k) {
+		float d[3] = { cosf(0.7f * k) * cosf(0.3f * k - 1.f), sinf(0.7f * k) * cosf(0.3f * k - 1.f),
+			sinf(0.3f * k - 1.f) };
+		float rd[3], y[16], expected[16];
+		harmonics(d, y);
+		rotate(r, d, rd);
+		harmonics(rd, expected);
+
+		for (int l = 1; l <= BNO_HOA_MAX_ORDER; ++l) {
+			const float *block = matrix + bnoHoaBlockOffset(l);
+			int size = 2 * l + 1;
+			int first = l * l;
+			for (int i = 0; i < size; ++i) {
+				float value = 0.f;
+				for (int j = 0; j < size; ++j) {
+					value += block[i * size + j] * y[first + j];
+				}
+				BNO_CHECK_NEAR(value, expected[first + i], 1e-4);
+			}
+		}
+	}
+}
+
+int main() {
+	BNO_CHECK(bnoHoaChannels(3) == 16);
+	BNO_CHECK(bnoHoaMatrixSize(BNO_HOA_MAX_ORDER) == BNO_HOA_MATRIX_SIZE);
+	BNO_CHECK(bnoHoaBlockOffset(2) == 9);
+	testQuatToMatrix();
+	testHoaRotation(axisAngle(0.f, 0.f, 1.f, 0.f));
+	testHoaRotation(axisAngle(0.f, 0.f, 1.f, 1.f));
+	testHoaRotation(axisAngle(1.f, 0.f, 0.f, -0.6f));
+	testHoaRotation(axisAngle(0.3f, -0.8f, 0.5f, 2.5f));
+	return bnoTestResult("rotation");
+}
@@ -0,0 +1,84 @@
+/*
+  BNO_Shm: frames published by BNO_ShmWriter are read back by a consumer
+  with the header only, an empty ring has no frame, and frames that have
+  been overwritten are refused.
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include "../imu/BNO_ShmWriter.h"
+#include "BNO_Test.h"
+
+static void publish(BNO_ShmWriter &writer, int index) {
+	bnoFrame_t frame = {};
+	frame.time = 1000 + index;
+	frame.accel[0] = (int16_t)index;
+	frame.quat[0] = 16384; // 1.0
+	frame.calib = 0xff;
+	frame.onsetCount = index;
+	writer.write(frame);
+}
+
+static void testAvailable() {
+	BNO_CHECK(!bnoShmAvailable(0, 0));
+	BNO_CHECK(!bnoShmAvailable(0, (uint32_t)-1));
+	BNO_CHECK(bnoShmAvailable(1, 0));
+	BNO_CHECK(!bnoShmAvailable(1, 1));
+	BNO_CHECK(bnoShmAvailable(100, 99));
+	BNO_CHECK(bnoShmAvailable(100, 100 - (BNO_SHM_SLOTS - 1)));
+	// the oldest slot may be being rewritten
+	BNO_CHECK(!bnoShmAvailable(100, 100 - BNO_SHM_SLOTS));
+	// across the wrap of the count
+	BNO_CHECK(bnoShmAvailable(3, (uint32_t)-2));
+}
+
+static void testRing(const char *name) {
+	BNO_ShmWriter writer;
+	BNO_CHECK(writer.open(name));
+	const bnoShm_t *shm = bnoShmOpen(name);
+	BNO_CHECK(shm != NULL);
+	if (shm == NULL) {
+		return;
+	}
+
+	// nothing published yet, the zeroed slots aren't frames
+	bnoShmFrame_t frame;
+	BNO_CHECK(bnoShmCount(shm) == 0);
+	BNO_CHECK(bnoShmLatest(shm, &frame) == -1);
+	BNO_CHECK(bnoShmRead(shm, 0, &frame) == -1);
+
+	publish(writer, 0);
+	BNO_CHECK(bnoShmLatest(shm, &frame) == 0);
+	BNO_CHECK(frame.time == 1000);
+	BNO_CHECK_NEAR(frame.quat[0], 1.0, 1e-6);
+	BNO_CHECK(frame.calib == 0xff);
+
+	for (int i = 1; i < 200; ++i) {
+		publish(writer, i);
+	}
+	BNO_CHECK(bnoShmCount(shm) == 200);
+	BNO_CHECK(bnoShmLatest(shm, &frame) == 0);
+	BNO_CHECK(frame.time == 1199);
+	BNO_CHECK(frame.onsetCount == 199);
+	BNO_CHECK_NEAR(frame.accel[0], 199 * 0.01, 1e-4);
+
+	uint32_t oldest = 200 - (BNO_SHM_SLOTS - 1);
+	BNO_CHECK(bnoShmRead(shm, oldest, &frame) == 0);
+	BNO_CHECK(frame.time == 1000 + oldest);
+	BNO_CHECK(bnoShmRead(shm, oldest - 1, &frame) == -1);
+	BNO_CHECK(bnoShmRead(shm, 200, &frame) == -1);
+
+	bnoShmClose(shm);
+	writer.close();
+	// removed with the writer
+	BNO_CHECK(bnoShmOpen(name) == NULL);
+}
+
+int main() {
+	char name[64];
+	snprintf(name, sizeof(name), "/bno_test_%d", (int)getpid());
+	testAvailable();
+	testRing(name);
+	return bnoTestResult("shm");
+}
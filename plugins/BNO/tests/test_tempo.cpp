@@ -0,0 +1,89 @@
+/*
+  BNO_FFT and BNO_Tempo: the real FFT matches a direct DFT, and the tempo
+  and phase of a periodic signal are found.
+
+  Johannes Burström 2021
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "../imu/BNO_FFT.h"
+#include "../imu/BNO_Tempo.h"
+#include "BNO_Test.h"
+
+static void testFFT(int size) {
+	float in[BNO_FFT_MAX_SIZE];
+	float re[BNO_FFT_MAX_SIZE / 2 + 1], im[BNO_FFT_MAX_SIZE / 2 + 1];
+	srand(size);
+	for (int i = 0; i < size; ++i) {
+		in[i] = (float)rand() / RAND_MAX - 0.5f;
+	}
+	BNO_RealFFT fft(size);
+	BNO_CHECK(fft.size() == size);
+	fft.forward(in, re, im);
+
+	for (int k = 0; k <= size / 2; ++k) {
+		double dftRe = 0.0, dftIm = 0.0;
+		for (int n = 0; n < size; ++n) {
+			double angle = 2.0 * M_PI * k * n / size;
+			dftRe += in[n] * cos(angle);
+			dftIm -= in[n] * sin(angle);
+		}
+		BNO_CHECK_NEAR(re[k], dftRe, 1e-3);
+		BNO_CHECK_NEAR(im[k], dftIm, 1e-3);
+	}
+}
+
+// Circular distance between two phases
+static float phaseDistance(float a, float b) {
+	float d = fabsf(a - b);
+	return fminf(d, 1.f - d);
+}
+
+static void testTempo() {
+	BNO_Tempo tempo;
+	BNO_CHECK(tempo.bpm() == 0.f);
+
+	// 120 bpm is a period of 50 samples, with a little noise
+	srand(1);
+	int estimates = 0;
+	int last = -1; // sample of the last estimate
+	int n;
+	for (n = 0; n < 1000; ++n) {
+		float value = cosf(2.f * (float)M_PI * n / 50.f) + 0.5f
+			+ 0.1f * ((float)rand() / RAND_MAX - 0.5f);
+		if (tempo.add(value)) {
+			estimates++;
+			last = n;
+		}
+	}
+	BNO_CHECK(estimates > 0);
+	BNO_CHECK_NEAR(tempo.bpm(), 120.0, 2.0);
+	BNO_CHECK(tempo.confidence() > 0.5f);
+	// the peaks are on multiples of 50
+	BNO_CHECK(phaseDistance(tempo.phase(), (float)(last % 50) / 50.f) < 0.05f);
+
+	// out of range, so not found
+	tempo.reset();
+	tempo.setRange(150.f, 240.f);
+	for (n = 0; n < 1000; ++n) {
+		tempo.add(cosf(2.f * (float)M_PI * n / 50.f));
+	}
+	BNO_CHECK(fabsf(tempo.bpm() - 120.f) > 10.f || tempo.confidence() < 0.2f);
+
+	// noise has no tempo
+	tempo.reset();
+	tempo.setRange(40.f, 240.f);
+	for (n = 0; n < 1000; ++n) {
+		tempo.add((float)rand() / RAND_MAX);
+	}
+	BNO_CHECK(tempo.confidence() < 0.3f);
+}
+
+int main() {
+	testFFT(4);
+	testFFT(64);
+	testFFT(BNO_FFT_MAX_SIZE);
+	testTempo();
+	return bnoTestResult("tempo");
+}
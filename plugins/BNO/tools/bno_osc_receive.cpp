@@ -0,0 +1,150 @@
+/*
+  Receiver for the BNO OSC frame stream
+  ----------------------------------------------------------
+  Listens for the bundles sent with BNO_OSC (see BNO_Osc.h) and prints,
+  once a second, the bundle and frame rates, the frames lost to the
+  network or a full queue, and the last orientation. Run on the same
+  board, with BNO_OSC=127.0.0.1:port, it also prints the latency from
+  reading a frame to receiving it, since both use the monotonic clock.
+
+      bno_osc_receive [port]
+
+  Johannes Burström 2021
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../BNO_Osc.h"
+
+static uint64_t nowUs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int32_t readInt(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return (int32_t)ntohl(v);
+}
+
+static float readFloat(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	v = ntohl(v);
+	float f;
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+struct Stats {
+	int bundles = 0;
+	int frames = 0;
+	int lost = 0;
+	int malformed = 0;
+	double latency = 0.0; // us, sum
+	bool haveSeq = false;
+	uint32_t seq = 0;
+	float quat[4] = { 1.f, 0.f, 0.f, 0.f };
+	int calib = 0;
+};
+
+static void frame(Stats &stats, const char *args) {
+	uint32_t seq = (uint32_t)readInt(args);
+	if (stats.haveSeq && seq != stats.seq + 1) {
+		stats.lost += (int)(seq - stats.seq - 1);
+	}
+	stats.haveSeq = true;
+	stats.seq = seq;
+
+	uint64_t time = (uint64_t)readInt(args + 4) * 1000000 + (uint32_t)readInt(args + 8);
+	stats.latency += (double)(int64_t)(nowUs() - time);
+	for (int i = 0; i < 4; ++i) {
+		stats.quat[i] = readFloat(args + 12 + 4 * (9 + i));
+	}
+	stats.calib = readInt(args + 12 + 4 * 13);
+	stats.frames++;
+}
+
+static void message(Stats &stats, const char *p, int size) {
+	if (size != BNO_OSC_MESSAGE_SIZE || strcmp(p, BNO_OSC_ADDRESS) != 0
+			|| strcmp(p + 12, BNO_OSC_TYPETAGS) != 0) {
+		stats.malformed++;
+		return;
+	}
+	frame(stats, p + BNO_OSC_HEADER_SIZE);
+}
+
+static void packet(Stats &stats, const char *p, int size) {
+	if (size < 16 || memcmp(p, "#bundle", 8) != 0) {
+		stats.malformed++;
+		return;
+	}
+	stats.bundles++;
+	int pos = 16;
+	while (pos + 4 <= size) {
+		int length = readInt(p + pos);
+		pos += 4;
+		if (length <= 0 || pos + length > size) {
+			stats.malformed++;
+			return;
+		}
+		message(stats, p + pos, length);
+		pos += length;
+	}
+}
+
+int main(int argc, char **argv) {
+	int port = argc > 1 ? atoi(argv[1]) : 9000;
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(sock, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		perror("bind");
+		return 1;
+	}
+	// wake up for the report even when nothing arrives
+	struct timeval timeout = { 0, 100000 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	printf("Listening on port %d\n", port);
+
+	static char buffer[65536];
+	Stats stats;
+	uint64_t reportTime = nowUs() + 1000000;
+	while (true) {
+		ssize_t size = recv(sock, buffer, sizeof(buffer), 0);
+		if (size > 0) {
+			packet(stats, buffer, (int)size);
+		}
+		uint64_t now = nowUs();
+		if (now < reportTime) {
+			continue;
+		}
+		printf("%d bundles/s, %d frames/s, %d lost, %d malformed, latency %.1f ms, "
+			"quat %.3f %.3f %.3f %.3f, calib 0x%02x\n",
+			stats.bundles, stats.frames, stats.lost, stats.malformed,
+			stats.frames > 0 ? stats.latency / stats.frames / 1000.0 : 0.0,
+			stats.quat[0], stats.quat[1], stats.quat[2], stats.quat[3], stats.calib);
+		fflush(stdout);
+		stats.bundles = stats.frames = stats.lost = stats.malformed = 0;
+		stats.latency = 0.0;
+		reportTime = now + 1000000;
+	}
+	return 0;
+}